@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+
+"""Generate synthetic .cfdg designs for stress benchmarks.
+
+Each design is a single recursive shape whose cost can be dialed along one
+axis at a time:
+
+    --branch B      children per expansion
+    --depth D       generations; a design draws about B**D primitives
+    --shapes N      pick the depth that gives about N primitives instead
+    --decay F       scale factor from parent to child
+    --params P      extra numeric parameters carried down the recursion
+    --loop L        primitives drawn by a loop in every expansion
+    --rules R       weighted alternative rules for the recursive shape
+    --jitter J      random rotation (degrees) of every child
+    --path S        draw an S segment path instead of a primitive
+    --stroke W      stroke the path with width W instead of filling it
+    --blend MODE    blend mode of every primitive (Multiply, Screen, ...)
+
+Recursion is cut off by depth rather than by size so the shape count does
+not depend on the render size. Since the renderer expands the largest shape
+first, the frontier holds a whole generation at a time: about B**(D-1)
+shapes, which is what pushes the renderer into spilling to temp files.
+
+    python3 gencfdg.py --shapes 1e6 --params 4 -o stress.cfdg
+"""
+
+import argparse
+import math
+import sys
+
+PRIMITIVES = ["SQUARE", "CIRCLE", "TRIANGLE"]
+
+
+def depth_for(shapes, branch, loop):
+    """Number of generations that draws about the requested shape count."""
+    per_node = max(1, loop)
+    if branch < 2:
+        return max(0, int(round(shapes / per_node)) - 1)
+    # nodes = (B**(D+1) - 1) / (B - 1)
+    nodes = max(1.0, shapes / per_node)
+    return max(0, int(round(math.log(nodes * (branch - 1) + 1, branch))) - 1)
+
+
+def shape_count(branch, depth, loop):
+    per_node = max(1, loop)
+    if branch < 2:
+        return (depth + 1) * per_node
+    return (branch ** (depth + 1) - 1) // (branch - 1) * per_node
+
+
+def generate(branch=2, depth=10, decay=0.7, params=0, loop=0, rules=1, jitter=0.0,
+             path=0, stroke=0.0, blend=None):
+    """Return the text of a design."""
+    out = []
+    emit = out.append
+    count = shape_count(branch, depth, loop)
+    emit("// Generated by gencfdg.py: branch %d, depth %d, decay %g, params %d, loop %d,"
+         % (branch, depth, decay, params, loop))
+    emit("// rules %d, jitter %g, path %d, stroke %g, blend %s" %
+         (rules, jitter, path, stroke, blend or "none"))
+    emit("// about %d primitives" % count)
+    emit("")
+    emit("startshape Root")
+    emit("CF::Background = [b -1]")
+    # Only the depth limit ends the recursion, even for renders of 100 pixels
+    emit("CF::MinimumSize = %.3g" % min(1e-4, decay ** depth * 0.01))
+    emit("CF::MaxShapes = %d" % (count * 2 + 100))
+    if params:
+        # Parameter arithmetic inside a loop body is not a pure expression
+        emit("CF::Impure = 1")
+    emit("")
+
+    names = ["depth"] + ["p%d" % i for i in range(params)]
+    decl = ", ".join(["natural depth"] + ["number " + n for n in names[1:]])
+    start = ", ".join([str(depth)] + ["%d" % (i + 1) for i in range(params)])
+    emit("shape Root {")
+    emit("  Node(%s) []" % start)
+    emit("}")
+    emit("")
+
+    # Parameters are updated every generation and feed the color, so they
+    # cannot be optimized away
+    hue = " + ".join(["depth * 7"] + ["%s * %d" % (n, 3 + i) for i, n in enumerate(names[1:])])
+    child_args = ", ".join(["depth -- 1"] +
+                           ["%s * 0.9 + %d" % (n, i + 1) for i, n in enumerate(names[1:])])
+
+    mods = ["hue (%s)" % hue, "sat 0.8", "b 0.7", "a -0.3"]
+    if blend:
+        mods.append("blend CF::%s" % blend)
+    draw_mods = " ".join(mods)
+    step = 360.0 / branch
+    rot = "(%g * i + rand(-%g, %g))" % (step, jitter, jitter) if jitter else "(%g * i)" % step
+
+    emit("shape Node(%s)" % decl)
+    for r in range(rules):
+        emit("rule %g {" % (1.0 / (r + 1)))
+        prim = "Leaf" if path else PRIMITIVES[r % len(PRIMITIVES)]
+        if loop:
+            emit("  loop j = %d [] {" % loop)
+            emit("    %s [r (%g * j) x 0.3 s 0.25 %s]" % (prim, 360.0 / loop, draw_mods))
+            emit("  }")
+        else:
+            emit("  %s [%s]" % (prim, draw_mods))
+        emit("  if (depth > 0) {")
+        emit("    loop i = %d [] {" % branch)
+        emit("      Node(%s) [r %s x %g s %g]" % (child_args, rot, 0.5 + 0.1 * r, decay))
+        emit("    }")
+        emit("  }")
+        emit("}")
+    emit("")
+
+    if path:
+        emit("path Leaf {")
+        emit("  MOVETO(0.5, 0)")
+        emit("  loop k = 1, %d [] {" % path)
+        emit("    LINETO(cos(k * %r) * (0.3 + 0.2 * mod(k, 2)), sin(k * %r) * (0.3 + 0.2 * mod(k, 2)))"
+             % (360.0 / path, 360.0 / path))
+        emit("  }")
+        emit("  CLOSEPOLY()")
+        if stroke:
+            emit("  STROKE(%g) []" % stroke)
+        else:
+            emit("  FILL []")
+        emit("}")
+        emit("")
+    return "\n".join(out)
+
+
+def add_arguments(parser):
+    parser.add_argument("--branch", type=int, default=2, help="children per expansion")
+    parser.add_argument("--depth", type=int, default=10, help="generations")
+    parser.add_argument("--shapes", type=float, help="target primitive count (sets depth)")
+    parser.add_argument("--decay", type=float, default=0.7, help="child scale factor")
+    parser.add_argument("--params", type=int, default=0, help="extra shape parameters")
+    parser.add_argument("--loop", type=int, default=0, help="primitives per expansion")
+    parser.add_argument("--rules", type=int, default=1, help="alternative rules")
+    parser.add_argument("--jitter", type=float, default=0.0, help="random child rotation")
+    parser.add_argument("--path", type=int, default=0, help="path segments per leaf")
+    parser.add_argument("--stroke", type=float, default=0.0, help="stroke width for paths")
+    parser.add_argument("--blend", help="blend mode, e.g. Multiply")
+
+
+def from_arguments(args):
+    depth = args.depth
+    if args.shapes:
+        depth = depth_for(args.shapes, args.branch, args.loop)
+    return generate(branch=args.branch, depth=depth, decay=args.decay, params=args.params,
+                    loop=args.loop, rules=max(1, args.rules), jitter=args.jitter,
+                    path=args.path, stroke=args.stroke, blend=args.blend)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="generate stress test designs")
+    add_arguments(parser)
+    parser.add_argument("--output", "-o", help="output file (default stdout)")
+    args = parser.parse_args()
+    if args.branch < 1:
+        parser.error("--branch must be at least 1")
+
+    text = from_arguments(args)
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text + "\n")
+    else:
+        sys.stdout.write(text + "\n")
+
+
+if __name__ == "__main__":
+    main()
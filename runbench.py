@@ -0,0 +1,377 @@
+#!/usr/bin/env python3
+
+"""End-to-end benchmarks of the cfdg command line renderer.
+
+Renders a fixed set of designs at fixed sizes and variations and records,
+for each one, wall and CPU time, peak resident set size, temporary file
+bytes and shapes per second, plus the per-phase times and counters that
+cfdg reports with --stats-json. The results are written as JSON and compared
+against a stored baseline; any case that is slower than the baseline by
+more than the threshold is reported and makes the script exit with status 1.
+
+    python3 runbench.py                 run and compare with bench/baseline.json
+    python3 runbench.py --update        run and replace the baseline
+    python3 runbench.py -k mtree        only run cases whose name contains mtree
+    python3 runbench.py --sweep spill   scaling curve of one subsystem
+
+A sweep renders designs made by gencfdg.py, varying one generator setting
+(or the render size) while holding the others fixed, and reports how each
+render phase scales. Sweeps are not compared with the baseline; use --csv
+or --plot to get the curves out.
+"""
+
+import argparse
+import json
+import os
+import platform
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+import gencfdg
+
+# name, input file, variation, size, extra arguments
+CASES = [
+    ("mtree",       "input/mtree.cfdg",             "ABC", 1000, []),
+    ("sierpinski",  "input/sierpinski.cfdg",        "AAA", 1000, []),
+    ("quadcity",    "input/quadcity.cfdg",          "MPM", 1000, []),
+    ("bigpath",     "input/tests/bigpathtest.cfdg", "AAA",  800, []),
+    ("alloctest1",  "input/tests/alloctest1.cfdg",  "AAA",  800, []),
+    ("mtree-small", "input/mtree.cfdg",             "ABC", 1000, ["-x", "0.1"]),
+]
+
+DEFAULT_BASELINE = os.path.join("bench", "baseline.json")
+
+# subsystem: swept setting, its values, fixed gencfdg settings, render size,
+# phases of interest. The setting "size" is the render size, anything else
+# is a gencfdg.py option.
+SWEEPS = {
+    "expansion": ("shapes", [1e4, 1e5, 1e6, 1e7], {}, 500, ["expand"]),
+    "params":    ("params", [0, 2, 4, 8, 16], {"shapes": 1e6}, 500, ["expand"]),
+    "rules":     ("rules", [1, 2, 4, 8], {"shapes": 1e6, "jitter": 5}, 500, ["expand"]),
+    "spill":     ("shapes", [1e6, 1e7, 1e8], {"branch": 4}, 500,
+                  ["spill_write", "spill_read", "heap"]),
+    "merge":     ("shapes", [1e6, 1e7, 1e8], {"loop": 8}, 500, ["sort", "merge"]),
+    "raster":    ("size", [250, 500, 1000, 2000, 4000], {"shapes": 1e5}, None, ["raster"]),
+    "blend":     ("loop", [1, 4, 16], {"shapes": 1e5, "blend": "Multiply"}, 1000, ["raster"]),
+    "paths":     ("path", [4, 16, 64, 256, 1024], {"shapes": 1e4}, 500, ["expand", "raster"]),
+    "stroke":    ("path", [4, 16, 64, 256], {"shapes": 1e4, "stroke": 0.02}, 500,
+                  ["expand", "raster"]),
+}
+
+MSEC_RE = re.compile(r"took (?:a total of )?([0-9,]+) msec to (execute|render|process)")
+SHAPES_RE = re.compile(r"([0-9,]+) shapes")
+
+
+class TempWatcher(threading.Thread):
+    """Poll a private temp directory, tracking peak and total bytes written."""
+
+    def __init__(self, path, interval=0.01):
+        super().__init__(daemon=True)
+        self.path = path
+        self.interval = interval
+        self.peak = 0
+        self.sizes = {}
+        self.done = threading.Event()
+
+    def sample(self):
+        total = 0
+        try:
+            with os.scandir(self.path) as it:
+                for entry in it:
+                    try:
+                        size = entry.stat().st_size
+                    except OSError:
+                        continue
+                    total += size
+                    if size > self.sizes.get(entry.name, 0):
+                        self.sizes[entry.name] = size
+        except OSError:
+            return
+        self.peak = max(self.peak, total)
+
+    def run(self):
+        while not self.done.wait(self.interval):
+            self.sample()
+        self.sample()
+
+    def written(self):
+        return sum(self.sizes.values())
+
+
+def number(s):
+    return int(s.replace(",", ""))
+
+
+def run_case(cfdg, case, outdir):
+    name, path, variation, size, extra = case
+    tmpdir = tempfile.mkdtemp(prefix="cfdg-bench-")
+    env = dict(os.environ, TMPDIR=tmpdir)
+    output = os.path.join(outdir, name + ".png")
+    statsfile = os.path.join(outdir, name + ".json")
+    cmd = [cfdg, "-t", "--stats-json", statsfile, "-v", variation, "-s", str(size)] + \
+        extra + [path, output]
+
+    watcher = TempWatcher(tmpdir)
+    watcher.start()
+    start = time.monotonic()
+    proc = subprocess.Popen(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, env=env)
+    err = []
+    reader = threading.Thread(target=lambda: err.append(proc.stderr.read()), daemon=True)
+    reader.start()
+    _, status, usage = os.wait4(proc.pid, 0)
+    wall = time.monotonic() - start
+    reader.join()
+    proc.returncode = os.waitstatus_to_exitcode(status)
+    watcher.done.set()
+    watcher.join()
+    shutil.rmtree(tmpdir, ignore_errors=True)
+
+    text = err[0].decode("utf-8", "replace") if err else ""
+    result = {
+        "status": proc.returncode,
+        "wall": wall,
+        "cpu": usage.ru_utime + usage.ru_stime,
+        # ru_maxrss is kilobytes on Linux and bytes on macOS
+        "peak_rss": usage.ru_maxrss * (1 if sys.platform == "darwin" else 1024),
+        "temp_peak_bytes": watcher.peak,
+        "temp_written_bytes": watcher.written(),
+    }
+    phases = {}
+    for msec, phase in MSEC_RE.findall(text):
+        phases[phase] = number(msec) / 1000.0
+    if phases:
+        result["phases"] = phases
+    shapes = SHAPES_RE.findall(text)
+    if shapes:
+        result["shapes"] = number(shapes[-1])
+        result["shapes_per_sec"] = result["shapes"] / wall if wall > 0 else 0.0
+    # Per-phase monotonic times and counters from the renderer itself
+    try:
+        with open(statsfile) as f:
+            stats = json.load(f)
+        os.remove(statsfile)
+        phases.update(stats["phases"])
+        result["phases"] = phases
+        result["counters"] = stats["counters"]
+        result["shapes"] = stats["shapes"]
+        result["shapes_per_sec"] = stats["shapes"] / wall if wall > 0 else 0.0
+    except (OSError, ValueError, KeyError):
+        pass
+    if proc.returncode != 0:
+        result["stderr"] = text[-2000:]
+    return result
+
+
+def median(values):
+    values = sorted(values)
+    n = len(values)
+    return values[n // 2] if n % 2 else (values[n // 2 - 1] + values[n // 2]) / 2
+
+
+def summarize(runs):
+    """Combine repeated runs, taking the median of each numeric field."""
+    summary = dict(runs[0])
+    for key in ("wall", "cpu", "peak_rss", "temp_peak_bytes", "temp_written_bytes",
+                "shapes_per_sec"):
+        if all(key in r for r in runs):
+            summary[key] = median([r[key] for r in runs])
+    if all("phases" in r for r in runs):
+        summary["phases"] = {p: median([r["phases"].get(p, 0.0) for r in runs])
+                             for p in runs[0]["phases"]}
+    summary["runs"] = len(runs)
+    return summary
+
+
+def compare(results, baseline, threshold):
+    """Return a list of regression descriptions."""
+    regressions = []
+    base_cases = baseline.get("cases", {})
+    for name, cur in results["cases"].items():
+        base = base_cases.get(name)
+        if base is None or cur.get("status") != 0:
+            continue
+        for key in ("wall", "cpu", "peak_rss", "temp_written_bytes"):
+            b, c = base.get(key), cur.get(key)
+            if not b or c is None:
+                continue
+            ratio = c / b
+            if ratio > 1.0 + threshold:
+                regressions.append("%s: %s %.3g -> %.3g (%+.1f%%)"
+                                   % (name, key, b, c, (ratio - 1.0) * 100.0))
+    return regressions
+
+
+def sweep_values(sweep, points):
+    if points:
+        return [float(v) for v in points.split(",")]
+    return SWEEPS[sweep][1]
+
+
+def run_sweep(args, outdir):
+    """Render one design per swept value and return the list of points."""
+    setting, _, fixed, size, focus = SWEEPS[args.sweep]
+    points = []
+    print("%-12s %10s %12s %10s %10s %10s  %s" % (setting, "shapes", "shapes/s", "wall",
+                                                  "rss MB", "temp MB", " ".join(focus)))
+    for value in sweep_values(args.sweep, args.points):
+        options = dict(fixed)
+        render_size = size
+        if setting == "size":
+            render_size = int(value)
+        else:
+            options[setting] = value
+        parser = argparse.ArgumentParser()
+        gencfdg.add_arguments(parser)
+        argv = []
+        for k, v in options.items():
+            argv += ["--" + k, "%g" % v if isinstance(v, float) else str(v)]
+        gen = parser.parse_args(argv)
+        name = "%s-%g" % (args.sweep, value)
+        path = os.path.join(outdir, name + ".cfdg")
+        with open(path, "w") as f:
+            f.write(gencfdg.from_arguments(gen) + "\n")
+
+        case = (name, path, "AAA", render_size, [])
+        runs = [run_case(args.cfdg, case, outdir) for _ in range(max(1, args.repeat))]
+        result = summarize(runs)
+        result["value"] = value
+        points.append(result)
+        if result["status"] != 0:
+            print("%-12g FAIL: %d" % (value, result["status"]))
+            continue
+        phases = result.get("phases", {})
+        print("%-12g %10d %12.0f %10.3f %10.1f %10.1f  %s"
+              % (value, result.get("shapes", 0), result.get("shapes_per_sec", 0.0),
+                 result["wall"], result["peak_rss"] / 1048576.0,
+                 result["temp_written_bytes"] / 1048576.0,
+                 " ".join("%.3f" % phases.get(p, 0.0) for p in focus)))
+    return points
+
+
+def write_csv(path, setting, points):
+    phases = sorted({p for r in points for p in r.get("phases", {})})
+    with open(path, "w") as f:
+        f.write(",".join([setting, "status", "shapes", "wall", "cpu", "peak_rss",
+                          "temp_written_bytes"] + phases) + "\n")
+        for r in points:
+            row = [r["value"], r["status"], r.get("shapes", 0), r["wall"], r["cpu"],
+                   r["peak_rss"], r["temp_written_bytes"]]
+            row += [r.get("phases", {}).get(p, 0.0) for p in phases]
+            f.write(",".join(str(v) for v in row) + "\n")
+
+
+def plot(path, sweep, points):
+    try:
+        import matplotlib
+        matplotlib.use("Agg")
+        import matplotlib.pyplot as plt
+    except ImportError:
+        print("matplotlib is not installed, no plot written")
+        return
+    setting, _, _, _, focus = SWEEPS[sweep]
+    good = [r for r in points if r["status"] == 0]
+    xs = [r["value"] for r in good]
+    fig, ax = plt.subplots()
+    ax.plot(xs, [r["wall"] for r in good], marker="o", label="wall")
+    for phase in focus:
+        ax.plot(xs, [r.get("phases", {}).get(phase, 0.0) for r in good], marker=".",
+                label=phase)
+    ax.set_xscale("log")
+    ax.set_yscale("log")
+    ax.set_xlabel(setting)
+    ax.set_ylabel("seconds")
+    ax.set_title("%s sweep" % sweep)
+    ax.legend()
+    fig.savefig(path)
+    print("Plot written to", path)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="cfdg end-to-end benchmarks")
+    parser.add_argument("--cfdg", default="./cfdg", help="cfdg executable")
+    parser.add_argument("--baseline", default=DEFAULT_BASELINE, help="baseline JSON file")
+    parser.add_argument("--update", action="store_true", help="write results as the new baseline")
+    parser.add_argument("--output", "-o", help="write results JSON to this file")
+    parser.add_argument("--repeat", "-r", type=int, default=3, help="runs per case")
+    parser.add_argument("--threshold", type=float, default=0.10,
+                        help="allowed slowdown before a case is a regression (default 0.10)")
+    parser.add_argument("-k", dest="filter", default="", help="only run matching cases")
+    parser.add_argument("--sweep", choices=sorted(SWEEPS), help="run a scaling sweep")
+    parser.add_argument("--points", help="comma separated values for the swept setting")
+    parser.add_argument("--csv", help="write sweep results as CSV to this file")
+    parser.add_argument("--plot", help="plot sweep results to this image (needs matplotlib)")
+    args = parser.parse_args()
+
+    if not os.access(args.cfdg, os.X_OK):
+        sys.exit("%s not found, run make first" % args.cfdg)
+
+    outdir = tempfile.mkdtemp(prefix="cfdg-bench-out-")
+    if args.sweep:
+        try:
+            points = run_sweep(args, outdir)
+        finally:
+            shutil.rmtree(outdir, ignore_errors=True)
+        setting = SWEEPS[args.sweep][0]
+        if args.output:
+            with open(args.output, "w") as f:
+                json.dump({"sweep": args.sweep, "setting": setting, "points": points},
+                          f, indent=2, sort_keys=True)
+        if args.csv:
+            write_csv(args.csv, setting, points)
+        if args.plot:
+            plot(args.plot, args.sweep, points)
+        sys.exit(1 if any(r["status"] != 0 for r in points) else 0)
+
+    results = {
+        "host": platform.node(),
+        "machine": platform.machine(),
+        "time": time.strftime("%Y-%m-%dT%H:%M:%S"),
+        "cases": {},
+    }
+    failed = False
+    try:
+        for case in CASES:
+            if args.filter not in case[0]:
+                continue
+            runs = [run_case(args.cfdg, case, outdir) for _ in range(max(1, args.repeat))]
+            summary = summarize(runs)
+            results["cases"][case[0]] = summary
+            if summary["status"] != 0:
+                failed = True
+                print("%-12s FAIL: %d" % (case[0], summary["status"]))
+            else:
+                print("%-12s %8.3fs wall %8.3fs cpu %8.1fMB rss %10.1fKB temp"
+                      % (case[0], summary["wall"], summary["cpu"],
+                         summary["peak_rss"] / 1048576.0,
+                         summary["temp_written_bytes"] / 1024.0))
+    finally:
+        shutil.rmtree(outdir, ignore_errors=True)
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(results, f, indent=2, sort_keys=True)
+
+    if args.update:
+        os.makedirs(os.path.dirname(args.baseline) or ".", exist_ok=True)
+        with open(args.baseline, "w") as f:
+            json.dump(results, f, indent=2, sort_keys=True)
+        print("Baseline written to", args.baseline)
+    elif os.path.exists(args.baseline):
+        with open(args.baseline) as f:
+            regressions = compare(results, json.load(f), args.threshold)
+        for r in regressions:
+            print("REGRESSION", r)
+        failed = failed or bool(regressions)
+    else:
+        print("No baseline at %s, run with --update to create one" % args.baseline)
+
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,260 @@
+#!/usr/bin/env python3
+
+"""Golden-image and timing regression tests of the cfdg command line renderer.
+
+Renders every test design at a fixed variation and size, hashes the decoded
+pixels and compares the hash with the stored golden. Any pixel difference is
+a failure: an optimization must not change what is drawn. Each failure also
+reports the distance between 8x8 average hashes of the two images, so that a
+one pixel rounding change can be told apart from a broken design; use --save
+to keep the rendered images for inspection.
+
+CPU times are recorded as well and compared against a local timing
+baseline (timings are machine specific, so they are not kept with the
+goldens). Most test designs render in a few milliseconds, which is too
+noisy to judge one at a time, so individual designs are only checked if
+they take long enough; the total over all designs is always checked.
+
+    python3 rungolden.py                check pixels and timings
+    python3 rungolden.py --update       refresh the goldens and timing baseline
+    python3 rungolden.py -k lettest     only designs whose path contains lettest
+
+Goldens depend on the floating point behavior of the platform, so they are
+only expected to match on the platform that generated them.
+"""
+
+import argparse
+import glob
+import hashlib
+import json
+import os
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import zlib
+
+DESIGNS = ["input/tests/*.cfdg", "input/*.cfdg"]
+VARIATION = "AAA"
+SIZE = 300
+
+DEFAULT_GOLDEN = os.path.join("input", "tests", "golden.json")
+DEFAULT_TIMES = os.path.join("bench", "golden-times.json")
+
+# Designs faster than this (CPU seconds) are too noisy to time individually
+MIN_TIMED = 0.25
+
+
+def read_png(path):
+    """Decode a non-interlaced 8 or 16 bit PNG into (width, height, channels,
+    depth, raw pixel bytes)."""
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:8] != b"\x89PNG\r\n\x1a\n":
+        raise ValueError("not a PNG file")
+    pos = 8
+    idat = []
+    header = None
+    while pos < len(data):
+        length, kind = struct.unpack(">I4s", data[pos:pos + 8])
+        body = data[pos + 8:pos + 8 + length]
+        pos += 12 + length
+        if kind == b"IHDR":
+            header = struct.unpack(">IIBBBBB", body)
+        elif kind == b"IDAT":
+            idat.append(body)
+        elif kind == b"IEND":
+            break
+    width, height, depth, color, _, _, interlace = header
+    channels = {0: 1, 2: 3, 4: 2, 6: 4}.get(color)
+    if channels is None or depth not in (8, 16) or interlace:
+        raise ValueError("unsupported PNG format")
+
+    bpp = channels * depth // 8
+    stride = width * bpp
+    raw = zlib.decompress(b"".join(idat))
+    out = bytearray(height * stride)
+    prev = bytearray(stride)
+    for y in range(height):
+        kind = raw[y * (stride + 1)]
+        line = bytearray(raw[y * (stride + 1) + 1:(y + 1) * (stride + 1)])
+        if kind == 1:
+            for i in range(bpp, stride):
+                line[i] = (line[i] + line[i - bpp]) & 0xff
+        elif kind == 2:
+            line = bytearray((a + b) & 0xff for a, b in zip(line, prev))
+        elif kind == 3:
+            for i in range(stride):
+                left = line[i - bpp] if i >= bpp else 0
+                line[i] = (line[i] + ((left + prev[i]) >> 1)) & 0xff
+        elif kind == 4:
+            for i in range(stride):
+                a = line[i - bpp] if i >= bpp else 0
+                b = prev[i]
+                c = prev[i - bpp] if i >= bpp else 0
+                p = a + b - c
+                pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+                pred = a if pa <= pb and pa <= pc else (b if pb <= pc else c)
+                line[i] = (line[i] + pred) & 0xff
+        out[y * stride:(y + 1) * stride] = line
+        prev = line
+    return width, height, channels, depth, bytes(out)
+
+
+def pixel_hash(image):
+    width, height, channels, depth, pixels = image
+    h = hashlib.sha256(struct.pack(">IIBB", width, height, channels, depth))
+    h.update(pixels)
+    return h.hexdigest()
+
+
+def average_hash(image):
+    """64 bit perceptual hash: 8x8 block means of the color channels,
+    thresholded at their average."""
+    width, height, channels, depth, pixels = image
+    step = depth // 8
+    color = min(channels, 3) if channels != 2 else 1
+    sums = [0] * 64
+    counts = [0] * 64
+    for y in range(height):
+        row = (y * 8 // height) * 8
+        base = y * width * channels * step
+        for x in range(width):
+            p = base + x * channels * step
+            v = sum(pixels[p + c * step] for c in range(color))
+            cell = row + x * 8 // width
+            sums[cell] += v
+            counts[cell] += color
+    means = [s / n if n else 0.0 for s, n in zip(sums, counts)]
+    avg = sum(means) / 64.0
+    bits = 0
+    for m in means:
+        bits = (bits << 1) | (m > avg)
+    return "%016x" % bits
+
+
+def hamming(a, b):
+    return bin(int(a, 16) ^ int(b, 16)).count("1")
+
+
+def render(cfdg, path, output):
+    """Returns exit status, CPU seconds and stderr text."""
+    cmd = [cfdg, "-q", "-v", VARIATION, "-s", str(SIZE), path, output]
+    proc = subprocess.Popen(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    err = proc.stderr.read()
+    _, status, usage = os.wait4(proc.pid, 0)
+    proc.returncode = os.waitstatus_to_exitcode(status)
+    return proc.returncode, usage.ru_utime + usage.ru_stime, err.decode("utf-8", "replace")
+
+
+def load(path):
+    try:
+        with open(path) as f:
+            return json.load(f)
+    except (OSError, ValueError):
+        return None
+
+
+def save(path, data):
+    os.makedirs(os.path.dirname(path) or ".", exist_ok=True)
+    with open(path, "w") as f:
+        json.dump(data, f, indent=1, sort_keys=True)
+        f.write("\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="cfdg golden-image tests")
+    parser.add_argument("--cfdg", default="./cfdg", help="cfdg executable")
+    parser.add_argument("--golden", default=DEFAULT_GOLDEN, help="golden hash file")
+    parser.add_argument("--times", default=DEFAULT_TIMES, help="timing baseline file")
+    parser.add_argument("--update", action="store_true",
+                        help="write new goldens and timing baseline")
+    parser.add_argument("--repeat", "-r", type=int, default=3,
+                        help="renders per design, the fastest is kept")
+    parser.add_argument("--tolerance", type=float, default=0.25,
+                        help="allowed slowdown before a design fails (default 0.25)")
+    parser.add_argument("--save", metavar="DIR", help="keep rendered images in DIR")
+    parser.add_argument("-k", dest="filter", default="", help="only run matching designs")
+    args = parser.parse_args()
+
+    if not os.access(args.cfdg, os.X_OK):
+        sys.exit("%s not found, run make first" % args.cfdg)
+
+    goldens = load(args.golden) or {}
+    times = (load(args.times) or {}).get("designs", {})
+    new_goldens = dict(goldens)
+    new_times = dict(times)
+    failures = []
+    broken = False
+    total = base_total = 0.0
+    outdir = args.save or tempfile.mkdtemp(prefix="cfdg-golden-")
+    os.makedirs(outdir, exist_ok=True)
+
+    designs = sorted(p for pattern in DESIGNS for p in glob.glob(pattern))
+    try:
+        for path in designs:
+            if args.filter not in path:
+                continue
+            output = os.path.join(outdir, path.replace(os.sep, "_").replace(" ", "_")
+                                  .replace(".cfdg", ".png"))
+            cpus = []
+            for _ in range(max(1, args.repeat)):
+                status, cpu, err = render(args.cfdg, path, output)
+                cpus.append(cpu)
+                if status != 0:
+                    break
+            cpu = min(cpus)
+            if status != 0:
+                broken = True
+                failures.append("%s: cfdg exited with %d %s" % (path, status, err.strip()[-200:]))
+                print("%-48s FAIL: %d" % (path, status))
+                continue
+
+            image = read_png(output)
+            result = {"pixels": pixel_hash(image), "ahash": average_hash(image),
+                      "size": "%dx%d" % image[:2]}
+            new_goldens[path] = result
+            new_times[path] = cpu
+
+            note = ""
+            golden = goldens.get(path)
+            if golden is None:
+                note = "new"
+            elif golden["pixels"] != result["pixels"]:
+                note = "PIXELS DIFFER (ahash distance %d)" % hamming(golden["ahash"],
+                                                                     result["ahash"])
+                failures.append("%s: %s" % (path, note))
+            base = times.get(path)
+            if base is not None:
+                total += cpu
+                base_total += base
+                if base >= MIN_TIMED and cpu > base * (1.0 + args.tolerance):
+                    slow = "SLOWER %.3fs -> %.3fs" % (base, cpu)
+                    failures.append("%s: %s" % (path, slow))
+                    note = (note + " " + slow).strip()
+            print("%-48s %8.3fs %s" % (path, cpu, note or "ok"))
+    finally:
+        if not args.save:
+            shutil.rmtree(outdir, ignore_errors=True)
+
+    if args.update:
+        save(args.golden, new_goldens)
+        save(args.times, {"variation": VARIATION, "size": SIZE, "designs": new_times})
+        print("Goldens written to %s, timings to %s" % (args.golden, args.times))
+        sys.exit(1 if broken else 0)
+
+    if base_total > 0.0:
+        print("Total CPU %.3fs, baseline %.3fs (%+.1f%%)"
+              % (total, base_total, (total / base_total - 1.0) * 100.0))
+        if total > base_total * (1.0 + args.tolerance / 2.0):
+            failures.append("total CPU time %.3fs -> %.3fs" % (base_total, total))
+    for f in failures:
+        print("FAIL", f)
+    if not goldens:
+        print("No goldens at %s, run with --update to create them" % args.golden)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
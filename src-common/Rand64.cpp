@@ -25,7 +25,10 @@
 
 #include "Rand64.h"
 #include "myrandom.h"
+#include <algorithm>
+#include <array>
 #include <cstddef>
+#include <vector>
 
 Rand64 Rand64::Common;
 
@@ -132,20 +135,41 @@ int64_t Rand64::getDiscrete(unsigned count, const double* weights)
 {
     if (count == 0)
         return 0;
+    // A single weight needs no table, but still takes a draw
+    if (count == 1)
+        return getDiscreteTable(count, nullptr);
+
+    // Weight vectors from expressions fit on the stack
+    std::array<double, 128> local;
+    std::vector<double> big;
+    double* table = local.data();
+    if (count > local.size()) {
+        big.resize(count);
+        table = big.data();
+    }
+    DiscreteTable(count, weights, table);
+    return getDiscreteTable(count, table);
+}
+
+int64_t Rand64::getDiscreteTable(unsigned count, const double* table)
+{
+    CF::uniform_real_distribution<double> gen;
+    const double* end = table + (count > 1 ? count - 1 : 0);
+    return std::upper_bound(table, end, gen(mSeed)) - table;
+}
 
-    std::vector<double> w(count);
+void Rand64::DiscreteTable(unsigned count, const double* weights, double* table)
+{
+    // The same sums as CF::discrete_distribution, in the same order, so the
+    // draws do not change
+    if (count < 2)
+        return;
+    double sum = 0.0;
     for (unsigned i = 0; i < count; ++i)
-        w[i] = fabs(weights[i]);
-
-    std::size_t i(0);
-    CF::discrete_distribution<int64_t> sd(count, 0, 1,
-        [&w, &i](double)
-        {
-            auto weight = w[i];
-            ++i;
-            return weight;
-        });
-    return sd(mSeed);
+        sum = sum + fabs(weights[i]);
+    table[0] = fabs(weights[0]) / sum;
+    for (unsigned i = 1; i < count - 1; ++i)
+        table[i] = table[i - 1] + fabs(weights[i]) / sum;
 }
 
 
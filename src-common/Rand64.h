@@ -83,6 +83,12 @@ public:
     
     int64_t getDiscrete(unsigned count, const double* weights);
     
+    // Same draw as getDiscrete() from the count - 1 entry cumulative table
+    // that DiscreteTable() makes, so that constant weights are only summed
+    // once
+    int64_t getDiscreteTable(unsigned count, const double* table);
+    static void DiscreteTable(unsigned count, const double* weights, double* table);
+    
     Rand64& operator^=(const Rand64& r)
     {
         mSeed.mSeed ^= r.mSeed.mSeed;
@@ -36,6 +36,7 @@ public:
     ~abstractPngCanvas() override;
     void start(bool , const agg::rgba& , int , int ) override;
     void end() override;
+    std::size_t bufferBytes() const override { return mData.capacity(); }
     
 protected:
     const char* mOutputFileName;
@@ -324,15 +324,123 @@ namespace AST {
         return *after == '%' ? ret / 100.0 : ret;
     }
     
+    // Coefficients are hashed by which Cell-wide bucket they fall in. Two
+    // transforms that compare equal can only land in different buckets if a
+    // coefficient is within epsilon of a bucket edge, so lookups also probe
+    // the neighboring bucket for those coefficients.
+    static const double SymmCell = 1.0 / 1048576.0;
+    
+    static double
+    SymmCoefficient(const agg::trans_affine& tr, int i)
+    {
+        switch (i) {
+            case 0: return tr.sx;
+            case 1: return tr.shy;
+            case 2: return tr.shx;
+            case 3: return tr.sy;
+            case 4: return tr.tx;
+            default: return tr.ty;
+        }
+    }
+    
+    static std::int64_t
+    SymmBucket(double v)
+    {
+        static const double Limit = 4.0e18;
+        double b = std::floor(v / SymmCell);
+        if (!(b > -Limit)) return static_cast<std::int64_t>(-Limit);
+        if (!(b < Limit)) return static_cast<std::int64_t>(Limit);
+        return static_cast<std::int64_t>(b);
+    }
+    
+    SymmSet::SymmSet(SymmList& syms)
+    : mSyms(syms)
+    {
+    }
+    
+    std::size_t
+    SymmSet::KeyHash::operator()(const Key& k) const
+    {
+        std::uint64_t h = 0xcbf29ce484222325ULL;
+        for (std::int64_t v: k) {
+            h ^= static_cast<std::uint64_t>(v);
+            h *= 0x100000001b3ULL;
+            h ^= h >> 29;
+        }
+        return static_cast<std::size_t>(h);
+    }
+    
+    void
+    SymmSet::index(std::size_t i)
+    {
+        Key k;
+        for (int c = 0; c < 6; ++c)
+            k[c] = SymmBucket(SymmCoefficient(mSyms[i], c));
+        mIndex.emplace(k, i);
+    }
+    
+    bool
+    SymmSet::contains(const agg::trans_affine& tr) const
+    {
+        if (mIndex.empty())
+            return std::find(mSyms.begin(), mSyms.end(), tr) != mSyms.end();
+        
+        Key base;
+        std::array<int, 6> neighbor{};
+        int edges[6];
+        int numEdges = 0;
+        for (int c = 0; c < 6; ++c) {
+            double v = SymmCoefficient(tr, c);
+            if (!std::isfinite(v))
+                return false;       // never equal to anything
+            base[c] = SymmBucket(v);
+            double margin = 4.0 * agg::affine_epsilon + std::fabs(v) * 1.0e-14;
+            double lower = v - static_cast<double>(base[c]) * SymmCell;
+            if (lower < margin)
+                neighbor[c] = -1;
+            else if (SymmCell - lower < margin)
+                neighbor[c] = 1;
+            if (neighbor[c])
+                edges[numEdges++] = c;
+        }
+        
+        for (unsigned probe = 0; probe < (1u << numEdges); ++probe) {
+            Key k = base;
+            for (int e = 0; e < numEdges; ++e)
+                if (probe & (1u << e))
+                    k[edges[e]] += neighbor[edges[e]];
+            auto range = mIndex.equal_range(k);
+            for (auto it = range.first; it != range.second; ++it)
+                if (mSyms[it->second] == tr)
+                    return true;
+        }
+        return false;
+    }
+    
+    void
+    SymmSet::add(const agg::trans_affine& tr)
+    {
+        if (contains(tr))
+            return;
+        mSyms.push_back(tr);
+        if (mSyms.size() <= ScanLimit)
+            return;
+        if (mIndex.empty()) {
+            for (std::size_t i = 0; i < mSyms.size(); ++i)
+                index(i);
+        } else {
+            index(mSyms.size() - 1);
+        }
+    }
+    
     void
-    addUnique(SymmList& syms, agg::trans_affine& tr)
+    addUnique(SymmSet& syms, const agg::trans_affine& tr)
     {
-        if (std::find(syms.begin(), syms.end(), tr) == syms.end())
-            syms.push_back(tr);
+        syms.add(tr);
     }
 
     void
-    processDihedral(SymmList& syms, double order, double x, double y,
+    processDihedral(SymmSet& syms, double order, double x, double y,
                     bool dihedral, double angle, const yy::location& where)
     {
         if (order < 1.0)
@@ -358,7 +466,7 @@ namespace AST {
     // appropriate affine transforms to the SymmList. Avoid adding the identity
     // transform if it is already present in the SymmList.
     void
-    processSymmSpec(SymmList& syms, agg::trans_affine& tile, bool tiled,
+    processSymmSpec(SymmSet& syms, agg::trans_affine& tile, bool tiled,
                     std::vector<double>& data, const yy::location& where)
     {
         if (data.empty()) return;
@@ -1021,6 +1129,7 @@ namespace AST {
         std::vector<const ASTmodification*> ret;
         syms.clear();
         if (e == nullptr) return ret;
+        SymmSet symmSet(syms);
         
         std::vector<double> symmSpec;
         yy::location where;
@@ -1029,7 +1138,7 @@ namespace AST {
             switch (kid.mType) {
                 case FlagType:
                     if (snarfFlagOpts)
-                        processSymmSpec(syms, tile, tiled, symmSpec, where);
+                        processSymmSpec(symmSet, tile, tiled, symmSpec, where);
                     // Snarf and process the numeric arguments for the symmetry spec
                     where = kid.where;
                     snarfFlagOpts = true;
@@ -1052,7 +1161,7 @@ namespace AST {
                     break;
                 case ModType:
                     if (snarfFlagOpts)
-                        processSymmSpec(syms, tile, tiled, symmSpec, where);
+                        processSymmSpec(symmSet, tile, tiled, symmSpec, where);
                     snarfFlagOpts = false;
                     if (auto m = dynamic_cast<const ASTmodification*>(&kid)) {
                         if ((m->modClass &
@@ -1061,7 +1170,7 @@ namespace AST {
                         {
                             Modification mod;
                             kid.evaluate(mod, false, r);
-                            addUnique(syms, mod.m_transform);
+                            addUnique(symmSet, mod.m_transform);
                         } else {
                             ret.push_back(m);
                         }
@@ -1075,7 +1184,7 @@ namespace AST {
             }
         }
         if (snarfFlagOpts)
-            processSymmSpec(syms, tile, tiled, symmSpec, where);
+            processSymmSpec(symmSet, tile, tiled, symmSpec, where);
         return ret;
     }
 }
@@ -26,9 +26,11 @@
 #ifndef INCLUDE_AST_H
 #define INCLUDE_AST_H
 
+#include <array>
 #include <memory>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <string>
 #include "agg2/agg_math_stroke.h"
 #include "agg2/agg_trans_affine.h"
@@ -214,10 +216,30 @@ namespace AST {
         ARCTO, ARCREL, CURVETO, CURVEREL, CLOSEPOLY
     };
     
-    void addUnique(SymmList& syms, agg::trans_affine& tr);
-    void processDihedral(SymmList& syms, double order, double x, double y,
+    // Appends transforms to a SymmList, dropping any that are equal (within
+    // agg::affine_epsilon) to one already present. Small lists are scanned,
+    // large symmetry groups switch to a hash of the quantized coefficients.
+    class SymmSet {
+    public:
+        explicit SymmSet(SymmList& syms);
+        void add(const agg::trans_affine& tr);
+    private:
+        enum : std::size_t { ScanLimit = 16 };
+        using Key = std::array<std::int64_t, 6>;
+        struct KeyHash {
+            std::size_t operator()(const Key& k) const;
+        };
+        SymmList& mSyms;
+        std::unordered_multimap<Key, std::size_t, KeyHash> mIndex;
+        
+        bool contains(const agg::trans_affine& tr) const;
+        void index(std::size_t i);
+    };
+    
+    void addUnique(SymmSet& syms, const agg::trans_affine& tr);
+    void processDihedral(SymmSet& syms, double order, double x, double y,
                          bool dihedral, double angle, const yy::location& where);
-    void processSymmSpec(SymmList& syms, agg::trans_affine& tile, bool tiled,
+    void processSymmSpec(SymmSet& syms, agg::trans_affine& tile, bool tiled,
                          std::vector<double>& data, const yy::location& where);
     std::vector<const ASTmodification*>
          getTransforms(const ASTexpression* e, SymmList& syms, 
@@ -377,7 +377,7 @@ namespace AST {
                     // Child shape is different from parent, even though parameters are reused,
                     // and we can't finesse it in ASTreplacement::traverse(). Just
                     // copy the parameters with the correct shape type.
-                    return param_ptr(StackRule::alloc(parent, shapeType));
+                    return rti->internParams(param_ptr(StackRule::alloc(parent, shapeType)));
                 }
 		FALLTHROUGH;
             case SimpleParentArgs:
@@ -386,8 +386,9 @@ namespace AST {
                 return param_ptr(parent);
             case DynamicArgs: {
                 StackRule* ret = StackRule::alloc(shapeType, argSize, typeSignature);
+                param_ptr args(ret);
                 ret->evalArgs(rti, arguments.get(), parent);
-                return param_ptr(ret);
+                return rti ? rti->internParams(std::move(args)) : args;
             }
             case ShapeArgs:
                 return arguments->evalArgs(rti, parent);
@@ -473,6 +474,13 @@ namespace AST {
         }
     }
 
+    ASTcached::ASTcached(exp_ptr e1, int n)
+    : ASTexpression(e1->where, false, e1->isNatural, e1->mType), count(n)
+    {
+        mLocality = e1->mLocality;
+        e = std::move(e1);
+    }
+
     ASTmodTerm::ASTmodTerm(modTypeEnum t, const std::string& paramString, const yy::location& loc)
     : ASTexpression(loc, true, false, ModType), modType(t), args(nullptr), flags(0)
     {
@@ -500,6 +508,7 @@ namespace AST {
       modClass(m.modClass), entropyIndex(m.entropyIndex), canonical(m.canonical)
     {
         assert(m.modExp.empty());
+        updateParts();
     }
     
     ASTmodification::ASTmodification(mod_ptr m, const yy::location& loc)
@@ -522,6 +531,7 @@ namespace AST {
         modExp.swap(m->modExp);
         modClass = m->modClass;
         entropyIndex = (entropyIndex + m->entropyIndex) & 7;
+        updateParts();
         isConstant = modExp.empty();
         canonical = m->canonical;
     }
@@ -1050,6 +1060,11 @@ namespace AST {
                 return 3;
             }
             case RandDiscrete: {
+                if (mDiscreteCount) {
+                    if (res)
+                        *res = static_cast<double>(rti->mCurrentSeed.getDiscreteTable(mDiscreteCount, mDiscreteTable.data()));
+                    return 1;
+                }
                 std::array<double, AST::MaxVectorSize> w;
                 int wc = arguments->evaluate(res ? w.data() : nullptr, (int)w.size(), rti);
                 if (wc >= 1)
@@ -1322,6 +1337,28 @@ namespace AST {
         return e->evaluate(res, length, rti);
     }
     
+    int
+    ASTcached::evaluate(double* res, int length, RendererAST* rti) const
+    {
+        if (!res || !rti)
+            return e->evaluate(res, length, rti);
+        if (length < count)
+            return -1;
+        
+        const RendererAST::CacheFrame& frame =
+            rti->mCacheFrames[rti->mCacheFrames.size() - 1 - mFrame];
+        std::uint64_t stamp = mPerIteration ? frame.mIteration : frame.mExecution;
+        double* value = rti->mCacheValues.data() + frame.mValues + mOffset;
+        std::uint64_t& valueStamp = rti->mCacheStamps[frame.mStamps + mSlot];
+        if (valueStamp != stamp) {
+            if (e->evaluate(value, count, rti) != count)
+                return -1;
+            valueStamp = stamp;
+        }
+        std::copy(value, value + count, res);
+        return count;
+    }
+    
     int
     ASTmodTerm::evaluate(double* , int , RendererAST* ) const
     {
@@ -1431,7 +1468,7 @@ namespace AST {
     ASTmodification::evaluate(Modification& m, bool shapeDest, RendererAST* rti) const
     {
         if (shapeDest) {
-            m *= modData;
+            m.compose(modData, modParts);
         } else {
             if (m.merge(modData))
                 RendererAST::ColorConflict(rti, where);
@@ -1956,6 +1993,12 @@ namespace AST {
         ent.append("\xE8\xE9\xF6\x7E\x1A\xF1");
     }
     
+    void
+    ASTcached::entropy(std::string& ent) const
+    {
+        e->entropy(ent);
+    }
+    
     void
     ASTmodTerm::entropy(std::string& ent) const
     {
@@ -2030,6 +2073,17 @@ namespace AST {
     {
         Simplify(arguments, b);
         
+        if (functype == RandDiscrete && arguments && arguments->isConstant) {
+            // The weights are only summed once
+            std::array<double, AST::MaxVectorSize> w;
+            int wc = arguments->evaluate(w.data(), (int)w.size());
+            if (wc >= 1) {
+                mDiscreteCount = static_cast<unsigned>(wc);
+                mDiscreteTable.resize(mDiscreteCount - 1);
+                Rand64::DiscreteTable(mDiscreteCount, w.data(), mDiscreteTable.data());
+            }
+        }
+        
         if (isConstant) {
             std::array<double, AST::MaxVectorSize> result;
             int len = evaluate(result.data(), (int)result.size());
@@ -2315,6 +2369,7 @@ namespace AST {
                 modExp.push_back(std::move(mod));
             }
         }
+        updateParts();
         return nullptr;
     }
     
@@ -3298,6 +3353,7 @@ namespace AST {
             case CompilePhase::Simplify:
                 break;
         }
+        updateParts();
         return nullptr;
     }
     
@@ -3551,6 +3607,12 @@ namespace AST {
         j["parenthetical expression"] = *e;
     }
     
+    void
+    ASTcached::to_json(json& j) const
+    {
+        e->to_json(j);
+    }
+    
     void
     ASTmodTerm::to_json(json& j) const
     {
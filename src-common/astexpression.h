@@ -231,6 +231,8 @@ namespace AST {
         FuncType functype;
         exp_ptr arguments;
         double random;
+        std::vector<double> mDiscreteTable;     // for constant randint::discrete
+        unsigned mDiscreteCount = 0;            // weights, see simplify()
         ASTfunction() = delete;
         ASTfunction(const std::string& func, exp_ptr args, Rand64& r,
                     const yy::location& nameLoc, const yy::location& argsLoc,
@@ -452,6 +454,25 @@ namespace AST {
         ASTexpression* compile(CompilePhase ph, Builder* b) final;
         void to_json(json& j) const final;
     };
+    // A numeric expression that is invariant over a loop, or repeated within
+    // a rule body or loop iteration. It is evaluated on first use and its
+    // value kept in a hidden slot of the rule body or loop that owns it, see
+    // RendererAST::CacheFrame and CacheExpressions().
+    class ASTcached final : public ASTexpression {
+    public:
+        exp_ptr e;
+        int count;
+        unsigned mFrame = 0;            // cache frames above the owner's
+        unsigned mSlot = 0;
+        unsigned mOffset = 0;           // of the value in the owner's frame
+        bool mPerIteration = false;     // else once per rule or loop execution
+        ASTcached() = delete;
+        ASTcached(exp_ptr e1, int n);
+        ~ASTcached() final = default;
+        int evaluate(double* res = nullptr, int length = 0, RendererAST* rti = nullptr) const final;
+        void entropy(std::string& ent) const final;
+        void to_json(json& j) const final;
+    };
 
     class ASTmodTerm final : public ASTexpression {
     public:
@@ -496,6 +517,7 @@ namespace AST {
         };
         Modification    modData;
         ASTtermArray    modExp;
+        unsigned        modParts = Modification::AllParts;  // see updateParts()
         int             modClass;
         int             entropyIndex;
         bool            canonical;
@@ -506,6 +528,9 @@ namespace AST {
         ASTmodification(const ASTmodification& m, const yy::location& loc);
         ASTmodification(mod_ptr m, const yy::location& loc);
         ~ASTmodification() final;
+        // Call after changing modData so that evaluate() composes the parts
+        // that are not the identity
+        void updateParts() { modParts = modData.parts(); }
         int evaluate(double* dest = nullptr, int size = 0, RendererAST* rti = nullptr) const final;
         void evaluate(Modification& m, bool shapeDest, RendererAST*) const final;
         ASTexpression* simplify(Builder* b) final;
@@ -33,9 +33,11 @@
 #include "rendererAST.h"
 #include "attributes.h"
 #include "builder.h"
+#include "backwards.h"
 #include <typeinfo>
 #include <cmath>
 #include <cstddef>
+#include <algorithm>
 
 using std::floor;
 
@@ -72,6 +74,8 @@ namespace AST {
                                   const yy::location& typeLoc, const yy::location& nameLoc) 
     {
         mParameters.emplace_back(type, index, typeLoc + nameLoc);
+        if (isGlobal)
+            mParamIndex[index] = mParameters.size() - 1;
         ASTparameter& param = mParameters.back();
         param.isParameter = true;
         param.checkParam(typeLoc, nameLoc);
@@ -83,6 +87,8 @@ namespace AST {
                                      const yy::location& expLoc)
     {
         mParameters.emplace_back(index, def, nameLoc + expLoc);
+        if (isGlobal)
+            mParamIndex[index] = mParameters.size() - 1;
         ASTparameter& b = mParameters.back();
         b.checkParam(nameLoc, nameLoc);
         return b;
@@ -92,9 +98,24 @@ namespace AST {
     ASTrepContainer::addLoopParameter(int index, const yy::location& nameLoc)
     {
         mParameters.emplace_back(index, nameLoc);
+        if (isGlobal)
+            mParamIndex[index] = mParameters.size() - 1;
         mParameters.back().checkParam(nameLoc, nameLoc);
     }
     
+    ASTparameter*
+    ASTrepContainer::findParameter(int index)
+    {
+        if (isGlobal) {
+            auto pos = mParamIndex.find(index);
+            return pos == mParamIndex.end() ? nullptr : &mParameters[pos->second];
+        }
+        for (auto&& param: backwards(mParameters))
+            if (param.mName == index)
+                return &param;
+        return nullptr;
+    }
+    
     void
     ASTrepContainer::compile(CompilePhase ph, Builder* b, ASTloop* loop, ASTdefine* def)
     {
@@ -105,6 +126,11 @@ namespace AST {
                     mParameters.resize(i);
                     break;
                 }
+            if (isGlobal) {
+                mParamIndex.clear();
+                for (std::size_t i = 0; i < mParameters.size(); ++i)
+                    mParamIndex[mParameters[i].mName] = i;
+            }
         }
         
         b->push_repContainer(*this);
@@ -396,39 +422,133 @@ namespace AST {
         index.number = start;
         ++r->mStackSize;
         r->mLogicalStackTop = &index + 1;
-        for (;;) {
-            if (r->requestStop || Renderer::AbortEverything)
-                throw CfdgError(mLocation, "Stopping");
-            
-            if (step > 0.0) {
-                if (index.number >= end)
-                    break;
+        {
+            RendererAST::CacheScope cache(r, mLoopBody.mCacheValues, mLoopBody.mCacheSlots);
+            if (mBatchBody) {
+                traverseBlocks(loopChild, index, end, step, cache, r);
             } else {
-                if (index.number <= end)
-                    break;
+                for (;;) {
+                    if (r->requestStop || Renderer::AbortEverything)
+                        throw CfdgError(mLocation, "Stopping");
+                
+                    if (step > 0.0) {
+                        if (index.number >= end)
+                            break;
+                    } else {
+                        if (index.number <= end)
+                            break;
+                    }
+                    cache.nextIteration();
+                    if (mSimpleBody)
+                        mSimpleBody->ASTreplacement::traverse(loopChild, tr || opsOnly, r);
+                    else
+                        mLoopBody.traverse(loopChild, tr || opsOnly, r);
+                    mChildChange.evaluate(loopChild.mWorldState, true, r);
+                    index.number += step;
+                }
             }
-            mLoopBody.traverse(loopChild, tr || opsOnly, r);
-            mChildChange.evaluate(loopChild.mWorldState, true, r);
-            index.number += step;
         }
         mFinallyBody.traverse(loopChild, tr || opsOnly, r);
         --r->mStackSize;
         r->mLogicalStackTop = oldTop;
     }
     
+    void
+    ASTloop::traverseBlocks(Shape& loopChild, StackType& index, double end, double step,
+                            RendererAST::CacheScope& cache, RendererAST* r) const
+    {
+        // The loop states are made in order, as below, a block at a
+        // time. The body adjustment is composed with the whole block,
+        // then the children are finished and processed in order, as
+        // ASTreplacement::traverse() does. The body does not use the
+        // loop index, so it can run ahead of the children.
+        const ASTmodification& bodyChange = mSimpleBody->mChildChange;
+        unsigned colorParts = bodyChange.modParts & Modification::ColorPart;
+        Modification states[ModBatch::BlockSize];
+        double areas[ModBatch::BlockSize];
+        ModBatch::Block parents, children;
+        for (bool done = false; !done;) {
+            std::size_t n = 0;
+            for (; n < ModBatch::BlockSize; ++n) {
+                if (step > 0.0 ? index.number >= end : index.number <= end) {
+                    done = true;
+                    break;
+                }
+                states[n] = loopChild.mWorldState;
+                parents.set(n, loopChild.mWorldState);
+                mChildChange.evaluate(loopChild.mWorldState, true, r);
+                index.number += step;
+            }
+            ModBatch::compose(parents, false, mBodyMods, children, n,
+                              bodyChange.modParts);
+            ModBatch::area(children, n, areas);
+            for (std::size_t i = 0; i < n; ++i) {
+                if (r->requestStop || Renderer::AbortEverything)
+                    throw CfdgError(mLocation, "Stopping");
+                cache.nextIteration();
+                Shape child;
+                child.mShapeType = mSimpleBody->mShapeSpec.shapeType;
+                child.mWorldState = states[i];
+                r->mCurrentSeed ^= bodyChange.modData.mRand64Seed;
+                r->mCurrentSeed();
+                // Color, random seed and blend mode, the rest is in
+                // the block
+                child.mWorldState.compose(bodyChange.modData, colorParts);
+                children.get(i, child.mWorldState);
+                child.mAreaCache = areas[i];
+                child.mWorldState.mRand64Seed = r->mCurrentSeed;
+                child.mWorldState.mRand64Seed();
+                r->processShape(child);
+            }
+        }
+    }
+    
     void
     ASTtransform::traverse(const Shape& parent, bool tr, RendererAST* r) const
     {
-        static agg::trans_affine Dummy;
-        SymmList transforms;
-        std::vector<const ASTmodification*> mods = getTransforms(mExpHolder.get(), transforms, r, false, Dummy);
-        
         Rand64 cloneSeed = r->mCurrentSeed;
         Shape transChild(parent);
         bool opsOnly = mBody.mRepType == op;
         if (opsOnly && !tr)
             transChild.mWorldState.m_transform.reset();
         
+        // Specialized mBody.traverse() with cloning behavior
+        auto traverseChild = [&](const Shape& child) {
+            r->mCurrentSeed();
+            std::size_t s = r->mStackSize;
+            for (const rep_ptr& rep: mBody.mBody) {
+                if (mClone)
+                    r->mCurrentSeed = cloneSeed;
+                rep->traverse(child, opsOnly || tr, r);
+            }
+            r->unwindStack(s, mBody.mParameters);
+        };
+        
+        if (mPrecomputed) {
+            // Compose a block of constant transforms with transChild at a
+            // time, then traverse each child in order
+            ModBatch::Block parentBlock, children;
+            parentBlock.set(0, transChild.mWorldState);
+            std::size_t remaining = mTransforms.size();
+            for (const ModBatch::Block& transforms: mTransformBlocks) {
+                std::size_t n = std::min<std::size_t>(remaining, ModBatch::BlockSize);
+                remaining -= n;
+                ModBatch::compose(parentBlock, true, transforms, children, n,
+                                  Modification::TransformPart);
+                for (std::size_t i = 0; i < n; ++i) {
+                    Shape child(transChild);
+                    children.getTransform(i, child.mWorldState.m_transform);
+                    traverseChild(child);
+                }
+            }
+            return;
+        }
+        
+        static agg::trans_affine Dummy;
+        SymmList transforms;
+        std::vector<const ASTmodification*> mods =
+            getTransforms(mExpHolder.get(), transforms, r, false, Dummy);
+        
         std::size_t modsLength = mods.size();
         std::size_t totalLength = modsLength + transforms.size();
         for(std::size_t i = 0; i < totalLength; ++i) {
@@ -438,16 +558,7 @@ namespace AST {
             } else {
                 child.mWorldState.m_transform.premultiply(transforms[i - modsLength]);
             }
-            r->mCurrentSeed();
-
-            // Specialized mBody.traverse() with cloning behavior
-            std::size_t s = r->mStackSize;
-            for (const rep_ptr& rep: mBody.mBody) {
-                if (mClone)
-                    r->mCurrentSeed = cloneSeed;
-                rep->traverse(child, opsOnly || tr, r);
-            }
-            r->unwindStack(s, mBody.mParameters);
+            traverseChild(child);
         }
     }
     
@@ -602,10 +713,12 @@ namespace AST {
         cpath_ptr savedPath;
         
         if (mCachedPath && StackRule::Equal(mCachedPath->mParameters.get(), parent.mParameters.get())) {
+            ++r->mPathCacheHits;
             savedPath = std::move(r->mCurrentPath);
             r->mCurrentPath = std::move(mCachedPath);
             r->mCurrentCommand = r->mCurrentPath->mCommandInfo.begin();
         } else {
+            ++r->mPathCacheMisses;
             r->mCurrentPath->mTerminalCommand.mLocation = mLocation;
         }
         
@@ -739,6 +852,8 @@ namespace AST {
                 mLoopBody.mParameters.front().isNatural = bodyNatural;
                 mLoopBody.mParameters.front().mLocality = locality;
                 mLoopBody.compile(ph, b, this, nullptr);
+                // Stack positions are only assigned during type check
+                mIndexStackIndex = mLoopBody.mParameters.front().mStackIndex;
                 mFinallyBody.mParameters.front().isNatural = finallyNatural;
                 mFinallyBody.mParameters.front().mLocality = locality;
                 mFinallyBody.compile(ph, b);
@@ -768,6 +883,31 @@ namespace AST {
                 }
                 mLoopBody.compile(ph, b);
                 mFinallyBody.compile(ph, b);
+                
+                // A body that is one plain replacement with no arguments and
+                // a constant adjustment pushes nothing on the stack, so
+                // traverse() can call it directly, without the container
+                // loop, stack unwinding or virtual dispatch.
+                mSimpleBody = nullptr;
+                if (mLoopBody.mBody.size() == 1) {
+                    const ASTreplacement* rep = mLoopBody.mBody.front().get();
+                    if (typeid(*rep) == typeid(ASTreplacement) &&
+                        rep->mRepType == replacement &&
+                        rep->mShapeSpec.argSource == ASTruleSpecifier::NoArgs &&
+                        rep->mChildChange.modExp.empty())
+                    {
+                        mSimpleBody = rep;
+                    }
+                }
+                
+                // If the loop adjustment is constant too then the loop states
+                // only depend on each other, so traverse() can build a block
+                // of them and compose the body adjustment with all of them
+                mBatchBody = mSimpleBody && mChildChange.modExp.empty();
+                if (mBatchBody) {
+                    for (std::size_t i = 0; i < ModBatch::BlockSize; ++i)
+                        mBodyMods.set(i, mSimpleBody->mChildChange.modData);
+                }
                 break;
         }
     }
@@ -799,9 +939,44 @@ namespace AST {
                 if (mClone && !b->impure())
                     CfdgError::Error(mLocation, "Shape cloning only permitted in impure mode");
                 break;
-            case CompilePhase::Simplify:
+            case CompilePhase::Simplify: {
                 Simplify(mExpHolder, b);
+                
+                // A transform list made only of constant terms yields the
+                // same transforms on every traversal, so build it now. If the
+                // symmetry spec is in error the list is left to traverse(),
+                // which reports the error if this replacement is ever reached,
+                // as it did before the lists were precomputed.
+                mPrecomputed = false;
+                mTransforms.clear();
+                mTransformBlocks.clear();
+                if (!mExpHolder)
+                    break;
+                bool constant = true;
+                for (auto&& kid: *mExpHolder)
+                    constant = constant && kid.isConstant;
+                if (!constant)
+                    break;
+                try {
+                    static agg::trans_affine Dummy;
+                    mPrecomputed = getTransforms(mExpHolder.get(), mTransforms,
+                                                 nullptr, false, Dummy).empty();
+                } catch (CfdgError&) {
+                    mPrecomputed = false;
+                }
+                if (!mPrecomputed) {
+                    mTransforms.clear();
+                    break;
+                }
+                mTransformBlocks.resize((mTransforms.size() + ModBatch::BlockSize - 1) /
+                                        ModBatch::BlockSize);
+                for (std::size_t i = 0; i < mTransforms.size(); ++i) {
+                    Modification m;
+                    m.m_transform = mTransforms[i];
+                    mTransformBlocks[i / ModBatch::BlockSize].set(i % ModBatch::BlockSize, m);
+                }
                 break;
+            }
         }
     }
     
@@ -992,6 +1167,8 @@ namespace AST {
         ASTreplacement::compile(ph, b);
         mRuleBody.compile(ph, b);
         b->mInPathContainer = false;
+        if (ph == CompilePhase::Simplify)
+            CacheExpressions(*this);
     }
     
     void
@@ -1574,6 +1751,7 @@ namespace AST {
                 CfdgError::Error(mArguments->where, "Cannot evaluate arguments", b);
             mArguments.reset();
             mChildChange.modData.m_transform.load_from(data.data());
+            mChildChange.updateParts();
         }
     }
 
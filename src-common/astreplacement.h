@@ -33,9 +33,11 @@
 #include "rendererAST.h"
 #include "shape.h"
 #include "primShape.h"
+#include "modBatch.h"
 #include <string>
 #include <map>
 #include <list>
+#include <unordered_map>
 #include <cstddef>
 #include "CmdInfo.h"
 #include "agg2/agg_path_storage.h"
@@ -85,6 +87,11 @@ namespace AST {
         ASTbody mBody;
         ASTparameters mParameters;
         bool isGlobal = false;
+        unsigned mCacheValues = 0;      // frame size for a rule body or loop
+        unsigned mCacheSlots = 0;       // body, see CacheExpressions()
+        // Last position of each name in the global parameters, which can
+        // be huge in generated designs
+        std::unordered_map<int, std::size_t> mParamIndex;
         
         ASTrepContainer() = default;
         ASTrepContainer(const ASTrepContainer&) = delete;
@@ -97,6 +104,8 @@ namespace AST {
             std::size_t s = r->mStackSize;
             if (getParams && parent.mParameters)
                 r->initStack(parent.mParameters.get());
+            RendererAST::CacheScope cache(r, getParams ? mCacheValues : 0,
+                                          getParams ? mCacheSlots : 0);
             for (const rep_ptr& rep: mBody)
                 rep->traverse(parent, tr, r);
             r->unwindStack(s, mParameters);
@@ -107,10 +116,17 @@ namespace AST {
         ASTparameter& addDefParameter(int index, ASTdefine* def,
                           const yy::location& nameLoc, const yy::location& expLoc);
         void addLoopParameter(int index, const yy::location& nameLoc);
+        ASTparameter* findParameter(int index);
     };
 
     void to_json(json& j, const ASTrepContainer& p);
     
+    // Replaces the pure numeric expressions of a rule that are invariant over
+    // a loop, or repeated within the rule body or a loop iteration, with
+    // ASTcached expressions and sizes the cache frames of the rule body and
+    // its loops. Called after the rule is simplified.
+    void CacheExpressions(ASTrule& rule);
+    
     class ASTloop final: public ASTreplacement {
     public:
         exp_ptr mLoopArgs;
@@ -120,6 +136,10 @@ namespace AST {
         ASTrepContainer mFinallyBody;
         int mLoopIndexName;
         std::string mLoopName;
+        const ASTreplacement* mSimpleBody = nullptr;    // see compile()
+        bool mBatchBody = false;        // mSimpleBody iterations done in blocks
+        ModBatch::Block mBodyMods;      // mSimpleBody's adjustment in every entry
+        int mIndexStackIndex = -1;      // from type check, see CacheExpressions()
         
         static void setupLoop(double& start, double& end, double& step, 
                               const ASTexpression* e, RendererAST* rti = nullptr);
@@ -132,12 +152,19 @@ namespace AST {
         void compile(CompilePhase ph, Builder* b) final;
         void compileLoopMod(Builder* b);
         void to_json(json& j) const final;
+    private:
+        void traverseBlocks(Shape& loopChild, StackType& index, double end,
+                            double step, RendererAST::CacheScope& cache,
+                            RendererAST* r) const;
     };
     class ASTtransform final: public ASTreplacement {
     public:
         ASTrepContainer mBody;
         exp_ptr mExpHolder;              // strong pointer
         bool mClone;
+        bool mPrecomputed = false;       // mTransforms is the whole list
+        SymmList mTransforms;
+        std::vector<ModBatch::Block> mTransformBlocks;  // mTransforms, in blocks
         
         ASTtransform(const yy::location& loc, exp_ptr mods);
         ~ASTtransform() final;
@@ -0,0 +1,492 @@
+// bench-kernels.cpp
+// this file is part of Context Free
+// ---------------------
+// Copyright (C) 2026 John Horigan - john@glyphic.com
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+// John Horigan can be contacted at john@glyphic.com or at
+// John Horigan, 1209 Villa St., Mountain View, CA 94041-1123, USA
+//
+//
+
+
+#include "bench.h"
+#include "chunk_vector.h"
+#include "shape.h"
+#include "Rand64.h"
+#include "myrandom.h"
+#include "HSBColor.h"
+#include "bounds.h"
+#include "pathIterator.h"
+#include "CmdInfo.h"
+#include "aggCanvas.h"
+#include "primShape.h"
+#include "modBatch.h"
+#include "astexpression.h"
+#include "agg2/agg_color_rgba.h"
+#include "agg2/agg_path_storage.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+using namespace AST;
+
+// Kernels for cfdg-bench. Iteration counts are part of each benchmark's
+// identity: change one and its history is no longer comparable.
+
+namespace {
+    Shape randomShape(Rand64& r)
+    {
+        Shape s;
+        s.mShapeType = static_cast<int>(r.getDouble() * 3.0);
+        s.mWorldState.m_transform = agg::trans_affine_scaling(r.getDouble() + 0.01) *
+                                    agg::trans_affine_rotation(r.getDouble() * 6.28) *
+                                    agg::trans_affine_translation(r.getDouble(), r.getDouble());
+        s.mWorldState.m_Z.tz = std::floor(r.getDouble() * 16.0);
+        s.mAreaCache = s.mWorldState.area();
+        return s;
+    }
+
+    std::vector<Shape> randomShapes(std::size_t n)
+    {
+        Rand64 r(12345);
+        std::vector<Shape> shapes;
+        shapes.reserve(n);
+        for (std::size_t i = 0; i < n; ++i)
+            shapes.push_back(randomShape(r));
+        return shapes;
+    }
+
+    // A closed star: the fill and stroke cases of a typical path
+    agg::path_storage starPath(int points)
+    {
+        agg::path_storage path;
+        for (int i = 0; i < points * 2; ++i) {
+            double a = MY_PI * i / points;
+            double rad = (i & 1) ? 0.2 : 0.5;
+            if (i)
+                path.line_to(rad * std::cos(a), rad * std::sin(a));
+            else
+                path.move_to(rad, 0.0);
+        }
+        path.end_poly(agg::path_flags_close);
+        return path;
+    }
+
+    class BenchCanvas : public aggCanvas {
+    public:
+        BenchCanvas(int width, int height)
+        : aggCanvas(RGBA8_Blend), mData(static_cast<std::size_t>(width * height * 4))
+        {
+            attach(mData.data(), width, height, width * 4);
+            start(true, agg::rgba(1, 1, 1, 1), width, height);
+        }
+    private:
+        std::vector<unsigned char> mData;
+    };
+
+    void drawPrimitives(Bench::State& state, int shape)
+    {
+        BenchCanvas canvas(512, 512);
+        RGBA8 color(agg::rgba(0.2, 0.4, 0.6, 0.5));
+        Rand64 r(1);
+        std::vector<agg::trans_affine> trans;
+        for (int i = 0; i < 1024; ++i)
+            trans.push_back(agg::trans_affine_scaling(2.0 + r.getDouble() * 30.0) *
+                            agg::trans_affine_rotation(r.getDouble() * 6.28) *
+                            agg::trans_affine_translation(r.getDouble() * 512.0,
+                                                          r.getDouble() * 512.0));
+        state.start();
+        for (std::uint64_t i = 0; i < state.iterations; ++i)
+            canvas.primitive(shape, color, trans[i & 1023], agg::comp_op_src_over);
+        state.stop();
+    }
+
+    Modification randomModification(Rand64& r)
+    {
+        Modification m;
+        m.m_transform = agg::trans_affine_scaling(r.getDouble() + 0.01, r.getDouble() + 0.01) *
+                        agg::trans_affine_skewing(r.getDouble(), 0.0) *
+                        agg::trans_affine_rotation(r.getDouble() * 6.28) *
+                        agg::trans_affine_translation(r.getDouble() * 10.0, r.getDouble());
+        m.m_Z.sz = r.getDouble() * 2.0;
+        m.m_Z.tz = r.getDouble() - 0.5;
+        m.m_time.st = r.getDouble() + 0.5;
+        m.m_time.tbegin = r.getDouble();
+        m.m_time.tend = m.m_time.tbegin + r.getDouble();
+        return m;
+    }
+
+    bool sameEntries(const ModBatch::Block& a, const ModBatch::Block& b, std::size_t n)
+    {
+        const double* fa[] = { a.sx, a.shy, a.shx, a.sy, a.tx, a.ty, a.sz, a.tz, a.st, a.tbegin, a.tend };
+        const double* fb[] = { b.sx, b.shy, b.shx, b.sy, b.tx, b.ty, b.sz, b.tz, b.st, b.tbegin, b.tend };
+        for (std::size_t f = 0; f < 11; ++f)
+            if (std::memcmp(fa[f], fb[f], n * sizeof(double)))
+                return false;
+        return true;
+    }
+
+    // Checks the batch kernels bit for bit against Modification::compose(),
+    // area() and isFinite(), then times composing one block
+    void composeBatch(Bench::State& state, bool simd)
+    {
+        using ModBatch::BlockSize;
+        ModBatch::useSimd(simd);
+        Rand64 r(7);
+        std::vector<Modification> parent(BlockSize), mod(BlockSize);
+        ModBatch::Block parents, mods, out, expect;
+        for (std::size_t i = 0; i < BlockSize; ++i) {
+            parent[i] = randomModification(r);
+            mod[i] = randomModification(r);
+            parents.set(i, parent[i]);
+            mods.set(i, mod[i]);
+        }
+
+        // One short of a block, so the AVX2 kernels run their scalar tail too
+        const std::size_t n = BlockSize - 1;
+        const unsigned partSets[] = {
+            Modification::TransformPart,
+            Modification::ZPart | Modification::TimePart,
+            Modification::TransformPart | Modification::ZPart | Modification::TimePart
+        };
+        for (unsigned parts: partSets) {
+            for (bool broadcast: { false, true }) {
+                ModBatch::compose(parents, broadcast, mods, out, n, parts);
+                for (std::size_t i = 0; i < n; ++i) {
+                    Modification m = parent[broadcast ? 0 : i];
+                    m.compose(mod[i], parts);
+                    expect.set(i, m);
+                }
+                Bench::check(sameEntries(out, expect, n), broadcast ? "compose broadcast" : "compose");
+            }
+        }
+
+        double areas[BlockSize];
+        bool finite[BlockSize];
+        parents.tx[3] = std::numeric_limits<double>::infinity();
+        parents.sz[6] = std::numeric_limits<double>::quiet_NaN();
+        parents.st[13] = -std::numeric_limits<double>::infinity();
+        ModBatch::area(parents, n, areas);
+        ModBatch::finite(parents, n, finite);
+        for (std::size_t i = 0; i < n; ++i) {
+            Modification m;
+            parents.get(i, m);
+            double a = m.area();
+            Bench::check(std::memcmp(&a, &areas[i], sizeof(double)) == 0, "area");
+            Bench::check(m.isFinite() == finite[i], "finite");
+        }
+        parents.set(3, parent[3]);
+        parents.set(6, parent[6]);
+        parents.set(13, parent[13]);
+
+        state.start();
+        for (std::uint64_t i = 0; i < state.iterations; ++i) {
+            ModBatch::compose(parents, false, mods, out, BlockSize,
+                              Modification::TransformPart | Modification::ZPart | Modification::TimePart);
+            ModBatch::area(out, BlockSize, areas);
+        }
+        state.stop();
+        Bench::keep(out);
+        Bench::keep(areas);
+        ModBatch::useSimd(true);
+    }
+
+    // Sets the type that Builder assigns during compilation
+    ASTexpression* numeric(ASTexpression* e)
+    {
+        e->mType = NumericType;
+        return e;
+    }
+}
+
+BENCH(chunk_vector, push_back, 2000000) {
+    Rand64 r(1);
+    Shape s = randomShape(r);
+    chunk_vector<Shape, 10> v;
+    state.start();
+    for (std::uint64_t i = 0; i < state.iterations; ++i)
+        v.push_back(s);
+    state.stop();
+    Bench::keep(v.size());
+}
+
+BENCH(chunk_vector, heap, 500000) {
+    std::vector<Shape> shapes = randomShapes(static_cast<std::size_t>(state.iterations));
+    chunk_vector<Shape, 10> v;
+    double total = 0.0;
+    state.start();
+    // The renderer's access pattern: a growing frontier with interleaved
+    // pushes and pops of the largest shape
+    for (std::uint64_t i = 0; i < state.iterations; ++i) {
+        v.push_back(shapes[i]);
+        std::push_heap(v.begin(), v.end());
+        if (i & 1) {
+            std::pop_heap(v.begin(), v.end());
+            total += v.back().area();
+            v.pop_back();
+        }
+    }
+    while (!v.empty()) {
+        std::pop_heap(v.begin(), v.end());
+        total += v.back().area();
+        v.pop_back();
+    }
+    state.stop();
+    Bench::keep(total);
+}
+
+BENCH(chunk_vector, sort, 500000) {
+    std::vector<Shape> shapes = randomShapes(static_cast<std::size_t>(state.iterations));
+    chunk_vector<FinishedShape, 10> v;
+    Bounds b;
+    int order = 0;
+    for (auto&& s: shapes)
+        v.emplace_back(std::move(s), ++order, b);
+    state.start();
+    std::sort(v.begin(), v.end());
+    state.stop();
+    Bench::keep(v.front().mWorldState.m_Z.tz);
+}
+
+BENCH(Rand64, getDouble, 20000000) {
+    Rand64 r(1);
+    double total = 0.0;
+    state.start();
+    for (std::uint64_t i = 0; i < state.iterations; ++i)
+        total += r.getDouble();
+    state.stop();
+    Bench::keep(total);
+}
+
+BENCH(Rand64, getNormal, 5000000) {
+    Rand64 r(1);
+    double total = 0.0;
+    state.start();
+    for (std::uint64_t i = 0; i < state.iterations; ++i)
+        total += r.getNormal(0.0, 1.0);
+    state.stop();
+    Bench::keep(total);
+}
+
+BENCH(Rand64, getExponential, 5000000) {
+    Rand64 r(1);
+    double total = 0.0;
+    state.start();
+    for (std::uint64_t i = 0; i < state.iterations; ++i)
+        total += r.getExponential(1.0);
+    state.stop();
+    Bench::keep(total);
+}
+
+BENCH(Rand64, getPoisson, 2000000) {
+    Rand64 r(1);
+    std::int64_t total = 0;
+    state.start();
+    for (std::uint64_t i = 0; i < state.iterations; ++i)
+        total += r.getPoisson(4.0);
+    state.stop();
+    Bench::keep(total);
+}
+
+BENCH(Rand64, getDiscrete, 2000000) {
+    static const double weights[] = {1.0, 0.5, 2.0, 0.05, 1.5, 0.25, 3.0, 1.0};
+    Rand64 r(1);
+    std::int64_t total = 0;
+    state.start();
+    for (std::uint64_t i = 0; i < state.iterations; ++i)
+        total += r.getDiscrete(8, weights);
+    state.stop();
+    Bench::keep(total);
+}
+
+BENCH(Rand64, getDiscreteTable, 2000000) {
+    static const double weights[] = {1.0, 0.5, 2.0, 0.05, 1.5, 0.25, 3.0, 1.0};
+    static const double odd[] = {0.3, -1.0, 0.0, 2.5, 1e-9, 0.7, -0.2, 4.0};
+    // Both draws must match the distribution they replaced, seed for seed
+    for (unsigned count = 1; count <= 8; ++count) {
+        XORshift64star ref(static_cast<XORshift64star::result_type>(count));
+        Rand64 r(count);
+        std::array<double, 8> table;
+        Rand64::DiscreteTable(count, odd, table.data());
+        for (int i = 0; i < 1000; ++i) {
+            std::size_t k = 0;
+            CF::discrete_distribution<std::int64_t> dd(count, 0, 1,
+                [&k](double) { return std::fabs(odd[k++]); });
+            std::int64_t expect = dd(ref);
+            std::int64_t got = (i & 1) ? r.getDiscrete(count, odd)
+                                       : r.getDiscreteTable(count, table.data());
+            Bench::check(got == expect, "discrete draw");
+        }
+    }
+    
+    std::array<double, 7> table;
+    Rand64::DiscreteTable(8, weights, table.data());
+    Rand64 r(1);
+    std::int64_t total = 0;
+    state.start();
+    for (std::uint64_t i = 0; i < state.iterations; ++i)
+        total += r.getDiscreteTable(8, table.data());
+    state.stop();
+    Bench::keep(total);
+}
+
+BENCH(Modification, multiply, 5000000) {
+    Modification m, d;
+    d.m_transform = agg::trans_affine_rotation(0.1) * agg::trans_affine_translation(0.5, 0.0);
+    d.m_Z.tz = 1.0;
+    d.m_Color.h = 7.0;
+    d.m_Color.b = 0.01;
+    d.mRand64Seed.seed(99);
+    state.start();
+    for (std::uint64_t i = 0; i < state.iterations; ++i)
+        m *= d;
+    state.stop();
+    Bench::keep(m);
+}
+
+BENCH(ModBatch, compose_scalar, 1000000) {
+    composeBatch(state, false);
+}
+
+BENCH(ModBatch, compose_simd, 1000000) {
+    composeBatch(state, true);
+}
+
+BENCH(HSBColor, Adjust, 10000000) {
+    HSBColor dest(0.0, 0.5, 0.5, 1.0), destTarget(180.0, 1.0, 1.0, 1.0);
+    HSBColor adj(3.0, 0.01, -0.01, -0.001), adjTarget(0.0, 0.5, 0.0, 0.0);
+    unsigned assign = HSBColor::SaturationTarget;
+    state.start();
+    for (std::uint64_t i = 0; i < state.iterations; ++i)
+        HSBColor::Adjust(dest, destTarget, adj, adjTarget, assign);
+    state.stop();
+    Bench::keep(dest);
+}
+
+BENCH(HSBColor, getRGBA, 10000000) {
+    agg::rgba c;
+    double total = 0.0;
+    state.start();
+    for (std::uint64_t i = 0; i < state.iterations; ++i) {
+        HSBColor hsb(static_cast<double>(i % 360), 0.75, 0.5 + 0.5 * ((i & 7) / 8.0), 1.0);
+        hsb.getRGBA(c);
+        total += c.r;
+    }
+    state.stop();
+    Bench::keep(total);
+}
+
+BENCH(ASTexpression, arithmetic, 5000000) {
+    // sin(2 * 0.25) + 10 / 3 - 1
+    yy::location loc;
+    Rand64 r(1);
+    exp_ptr prod(numeric(new ASToperator('*', new ASTreal(2.0, loc), new ASTreal(0.25, loc))));
+    std::unique_ptr<ASTexpression> e(numeric(new ASToperator('-',
+        numeric(new ASToperator('+',
+            numeric(new ASTfunction("sin", std::move(prod), r, loc, loc, nullptr)),
+            numeric(new ASToperator('/', new ASTreal(10.0, loc), new ASTreal(3.0, loc))))),
+        new ASTreal(1.0, loc))));
+    double total = 0.0, v;
+    state.start();
+    for (std::uint64_t i = 0; i < state.iterations; ++i) {
+        e->evaluate(&v, 1, nullptr);
+        total += v;
+    }
+    state.stop();
+    Bench::keep(total);
+}
+
+BENCH(ASTexpression, modification, 2000000) {
+    // [rotate 30 size 0.9 hue 10 x 1]
+    yy::location loc;
+    std::array<std::unique_ptr<ASTmodTerm>, 4> terms = {{
+        std::make_unique<ASTmodTerm>(ASTmodTerm::rot, new ASTreal(30.0, loc), loc),
+        std::make_unique<ASTmodTerm>(ASTmodTerm::size, new ASTreal(0.9, loc), loc),
+        std::make_unique<ASTmodTerm>(ASTmodTerm::hue, new ASTreal(10.0, loc), loc),
+        std::make_unique<ASTmodTerm>(ASTmodTerm::x, new ASTreal(1.0, loc), loc)
+    }};
+    for (auto&& term: terms)
+        term->argCount = 1;
+    double total = 0.0;
+    state.start();
+    for (std::uint64_t i = 0; i < state.iterations; ++i) {
+        Modification m;
+        for (auto&& term: terms)
+            term->evaluate(m, true, nullptr);
+        total += m.m_transform.tx;
+    }
+    state.stop();
+    Bench::keep(total);
+}
+
+BENCH(Bounds, update_fill, 500000) {
+    agg::path_storage star = starPath(12);
+    CommandInfo attr(&star);
+    attr.mFlags = CF_FILL;
+    pathIterator helper;
+    Bounds b;
+    agg::trans_affine tr = agg::trans_affine_scaling(20.0) * agg::trans_affine_rotation(0.3);
+    state.start();
+    for (std::uint64_t i = 0; i < state.iterations; ++i)
+        b.update(tr, helper, 1.0, attr);
+    state.stop();
+    Bench::keep(b);
+}
+
+BENCH(Bounds, update_stroke, 200000) {
+    agg::path_storage star = starPath(12);
+    CommandInfo attr(&star);
+    attr.mFlags = CF_MITER_JOIN | CF_JOIN_PRESENT;
+    attr.mStrokeWidth = 0.05;
+    pathIterator helper;
+    Bounds b;
+    agg::trans_affine tr = agg::trans_affine_scaling(20.0) * agg::trans_affine_rotation(0.3);
+    state.start();
+    for (std::uint64_t i = 0; i < state.iterations; ++i)
+        b.update(tr, helper, 1.0, attr);
+    state.stop();
+    Bench::keep(b);
+}
+
+BENCH(aggCanvas, circle, 200000) {
+    drawPrimitives(state, primShape::circleType);
+}
+
+BENCH(aggCanvas, square, 200000) {
+    drawPrimitives(state, primShape::squareType);
+}
+
+BENCH(aggCanvas, triangle, 200000) {
+    drawPrimitives(state, primShape::triangleType);
+}
+
+BENCH(aggCanvas, path_fill, 100000) {
+    BenchCanvas canvas(512, 512);
+    agg::path_storage star = starPath(12);
+    CommandInfo attr(&star);
+    attr.mFlags = CF_FILL;
+    RGBA8 color(agg::rgba(0.2, 0.4, 0.6, 0.5));
+    agg::trans_affine tr = agg::trans_affine_scaling(40.0) * agg::trans_affine_translation(256.0, 256.0);
+    state.start();
+    for (std::uint64_t i = 0; i < state.iterations; ++i)
+        canvas.path(color, tr, attr);
+    state.stop();
+}
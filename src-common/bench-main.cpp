@@ -0,0 +1,115 @@
+// bench-main.cpp
+// this file is part of Context Free
+// ---------------------
+// Copyright (C) 2026 John Horigan - john@glyphic.com
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+// John Horigan can be contacted at john@glyphic.com or at
+// John Horigan, 1209 Villa St., Mountain View, CA 94041-1123, USA
+//
+//
+
+
+#include "bench.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace {
+    void usage()
+    {
+        std::cerr <<
+            "Usage: cfdg-bench [options]\n"
+            "  -k FILTER       only run kernels whose name contains FILTER\n"
+            "  -r N            timed runs per kernel (default 5)\n"
+            "  -x SCALE        scale every iteration count by SCALE\n"
+            "  -o FILE         write results JSON to FILE\n"
+            "  -b FILE         compare results with a baseline JSON file\n"
+            "  -t FRACTION     allowed slowdown before a kernel is a regression (default 0.10)\n";
+    }
+
+    bool readFile(const char* path, std::string& contents)
+    {
+        std::ifstream in(path);
+        if (!in)
+            return false;
+        std::ostringstream ss;
+        ss << in.rdbuf();
+        contents = ss.str();
+        return true;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Bench::Options opts;
+    const char* output = nullptr;
+    const char* baseline = nullptr;
+    double threshold = 0.10;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-h") == 0 || std::strcmp(argv[i], "--help") == 0) {
+            usage();
+            return 0;
+        }
+        if (argv[i][0] != '-' || std::strlen(argv[i]) != 2 || i + 1 >= argc) {
+            usage();
+            return 2;
+        }
+        const char* arg = argv[++i];
+        switch (argv[i - 1][1]) {
+            case 'k': opts.filter = arg; break;
+            case 'r': opts.repeat = std::atoi(arg); break;
+            case 'x': opts.scale = std::atof(arg); break;
+            case 'o': output = arg; break;
+            case 'b': baseline = arg; break;
+            case 't': threshold = std::atof(arg); break;
+            default:
+                usage();
+                return 2;
+        }
+    }
+    if (opts.repeat < 1 || !(opts.scale > 0.0)) {
+        usage();
+        return 2;
+    }
+
+    std::string results = Bench::runAll(opts, std::cout);
+    bool checked = Bench::failures() == 0;
+
+    if (output) {
+        std::ofstream out(output);
+        out << results << '\n';
+        if (!out) {
+            std::cerr << "Could not write " << output << '\n';
+            return 1;
+        }
+    }
+
+    if (baseline) {
+        std::string base;
+        if (!readFile(baseline, base)) {
+            std::cerr << "No baseline at " << baseline << '\n';
+            return checked ? 0 : 1;
+        }
+        return Bench::compare(results, base, threshold, std::cout) && checked ? 0 : 1;
+    }
+    return checked ? 0 : 1;
+}
@@ -0,0 +1,193 @@
+// bench.cpp
+// this file is part of Context Free
+// ---------------------
+// Copyright (C) 2026 John Horigan - john@glyphic.com
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+// John Horigan can be contacted at john@glyphic.com or at
+// John Horigan, 1209 Villa St., Mountain View, CA 94041-1123, USA
+//
+//
+
+
+#include "bench.h"
+#include "json3.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace {
+    std::vector<Bench::benchmark*>& registry()
+    {
+        static std::vector<Bench::benchmark*> benchmarks;
+        return benchmarks;
+    }
+
+    std::int64_t now()
+    {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    volatile const void* sink = nullptr;
+
+    std::vector<std::string> mismatches;   // for the current kernel
+    int failedKernels = 0;
+}
+
+namespace Bench {
+    void
+    State::start()
+    {
+        mElapsed = 0;
+        mStart = now();
+        mRunning = true;
+    }
+
+    void
+    State::stop()
+    {
+        if (mRunning)
+            mElapsed += now() - mStart;
+        mRunning = false;
+    }
+
+    double
+    State::seconds() const
+    {
+        return static_cast<double>(mElapsed) * 1e-9;
+    }
+
+    benchmark::benchmark(const char* group, const char* n, std::uint64_t iters)
+    : name(std::string(group) + '.' + n), iterations(iters)
+    {
+        registry().push_back(this);
+    }
+
+    double
+    benchmark::measure()
+    {
+        State state(iterations);
+        state.start();
+        run(state);
+        state.stop();
+        return state.seconds();
+    }
+
+    void
+    consume(const void* p)
+    {
+        sink = p;
+    }
+
+    void
+    check(bool ok, const std::string& what)
+    {
+        if (!ok && std::find(mismatches.begin(), mismatches.end(), what) == mismatches.end())
+            mismatches.push_back(what);
+    }
+
+    int
+    failures()
+    {
+        return failedKernels;
+    }
+
+    std::string
+    runAll(const Options& opts, std::ostream& out)
+    {
+        json kernels = json::object();
+        char buf[256];
+
+        std::snprintf(buf, sizeof(buf), "%-32s %12s %12s %12s\n",
+                      "kernel", "iterations", "min ns/op", "median ns/op");
+        out << buf;
+        for (benchmark* b: registry()) {
+            if (b->name.find(opts.filter) == std::string::npos)
+                continue;
+            std::uint64_t base = b->iterations;
+            b->iterations = std::max<std::uint64_t>(1,
+                static_cast<std::uint64_t>(static_cast<double>(base) * opts.scale));
+
+            std::vector<double> times;
+            b->measure();       // warm caches and allocators
+            for (int i = 0; i < std::max(1, opts.repeat); ++i)
+                times.push_back(b->measure());
+            std::sort(times.begin(), times.end());
+
+            double n = static_cast<double>(b->iterations);
+            double best = times.front() * 1e9 / n;
+            double median = times[times.size() / 2] * 1e9 / n;
+            kernels[b->name] = {
+                {"iterations", b->iterations},
+                {"runs", times.size()},
+                {"min_ns", best},
+                {"median_ns", median}
+            };
+            std::snprintf(buf, sizeof(buf), "%-32s %12llu %12.2f %12.2f\n", b->name.c_str(),
+                          static_cast<unsigned long long>(b->iterations), best, median);
+            out << buf;
+            if (!mismatches.empty()) {
+                for (auto&& what: mismatches)
+                    out << "MISMATCH " << b->name << ": " << what << '\n';
+                kernels[b->name]["mismatch"] = true;
+                mismatches.clear();
+                ++failedKernels;
+            }
+            out << std::flush;
+            b->iterations = base;
+        }
+
+        json results = {
+            {"repeat", opts.repeat},
+            {"failures", failedKernels},
+            {"scale", opts.scale},
+            {"kernels", kernels}
+        };
+        return results.dump(2);
+    }
+
+    bool
+    compare(const std::string& results, const std::string& baseline,
+            double threshold, std::ostream& out)
+    {
+        json cur = json::parse(results);
+        json base = json::parse(baseline);
+        bool ok = true;
+        char buf[256];
+
+        for (auto&& kernel: cur["kernels"].items()) {
+            auto b = base["kernels"].find(kernel.key());
+            if (b == base["kernels"].end())
+                continue;
+            // The minimum is the least noisy estimate of the kernel's cost
+            double was = (*b)["min_ns"].get<double>();
+            double is = kernel.value()["min_ns"].get<double>();
+            if (was > 0.0 && is > was * (1.0 + threshold)) {
+                std::snprintf(buf, sizeof(buf), "REGRESSION %s: %.2f -> %.2f ns/op (%+.1f%%)\n",
+                              kernel.key().c_str(), was, is, (is / was - 1.0) * 100.0);
+                out << buf;
+                ok = false;
+            }
+        }
+        return ok;
+    }
+}
@@ -0,0 +1,103 @@
+// bench.h
+// this file is part of Context Free
+// ---------------------
+// Copyright (C) 2026 John Horigan - john@glyphic.com
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+// John Horigan can be contacted at john@glyphic.com or at
+// John Horigan, 1209 Villa St., Mountain View, CA 94041-1123, USA
+//
+//
+
+#ifndef INCLUDE_BENCH_H
+#define INCLUDE_BENCH_H
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+// A small microbenchmark harness in the spirit of test.h. Each BENCH body
+// is handed a State and performs state.iterations operations; the count is
+// fixed per benchmark so results from different builds are comparable.
+// Untimed setup goes before state.start(), and can verify results with
+// check(). The harness runs each benchmark
+// several times and reports the fastest and the median time per operation.
+
+namespace Bench {
+    class State {
+    public:
+        explicit State(std::uint64_t n) : iterations(n) {}
+        const std::uint64_t iterations;
+
+        void start();       // restart the clock, excluding setup
+        void stop();        // stop the clock, excluding teardown
+        double seconds() const;
+
+    private:
+        std::int64_t    mStart = 0;
+        std::int64_t    mElapsed = 0;
+        bool            mRunning = false;
+
+        friend class benchmark;
+    };
+
+    class benchmark {
+    public:
+        benchmark(const char* group, const char* name, std::uint64_t iterations);
+        virtual ~benchmark() = default;
+        virtual void run(State&) = 0;
+
+        std::string     name;
+        std::uint64_t   iterations;
+
+        double measure();   // seconds for one run
+    };
+
+    // Keeps the compiler from discarding a computed value
+    void consume(const void*);
+    template <typename T>
+    inline void keep(const T& v) { consume(&v); }
+
+    // Records a failed result check made in a benchmark's setup. Failed
+    // kernels are reported as MISMATCH and make cfdg-bench exit with 1.
+    void check(bool ok, const std::string& what);
+    int failures();         // kernels with a failed check so far
+
+    struct Options {
+        std::string     filter;
+        int             repeat = 5;
+        double          scale = 1.0;    // multiplies every iteration count
+    };
+
+    // Runs the matching benchmarks, printing a table to out and returning
+    // the results as a JSON document.
+    std::string runAll(const Options& opts, std::ostream& out);
+
+    // Compares a results document against a baseline, printing kernels
+    // that are slower by more than threshold. Returns false if any are.
+    bool compare(const std::string& results, const std::string& baseline,
+                 double threshold, std::ostream& out);
+}
+
+
+#define BENCH(group, name, iterations) \
+    struct Bench_##group##_##name : public ::Bench::benchmark { \
+        Bench_##group##_##name() : ::Bench::benchmark(#group, #name, iterations) { } \
+        void run(::Bench::State& state) override; \
+    } bench_##group##_##name; \
+    void Bench_##group##_##name::run(::Bench::State& state)
+
+#endif // INCLUDE_BENCH_H
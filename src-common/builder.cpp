@@ -398,11 +398,19 @@ Builder::MakeDefinition(AST::str_ptr name, const yy::location& nameLoc,
     
     // Check if a global definition shadows a pre-definition. If it does then
     // drop the global definition.
-    if (mContainerStack.back()->isGlobal && mIncludeDepth >= 0)
-        for (auto&& rep: mContainerStack.back()->mBody)
-            if (const ASTdefine* def = dynamic_cast<const ASTdefine*>(rep.get()))
-                if (def->mName == *name && def->mConfigDepth == -1)
-                    return nullptr;
+    if (mContainerStack.back()->isGlobal && mIncludeDepth >= 0) {
+        const ASTbody& body = mContainerStack.back()->mBody;
+        if (mGlobalDefinesSeen > body.size()) {
+            mGlobalDefines.clear();
+            mGlobalDefinesSeen = 0;
+        }
+        for (; mGlobalDefinesSeen < body.size(); ++mGlobalDefinesSeen)
+            if (const ASTdefine* def = dynamic_cast<const ASTdefine*>(body[mGlobalDefinesSeen].get()))
+                if (def->mConfigDepth == -1)
+                    mGlobalDefines.insert(def->mName);
+        if (mGlobalDefines.count(*name))
+            return nullptr;
+    }
     
     int nameIndex = StringToShape(*name, nameLoc, false);
     if (ASTdefine* funcDef = m_CFDG->findFunction(nameIndex)) {
@@ -843,11 +851,10 @@ ASTparameter*
 Builder::findExpression(int nameIndex, bool& isGlobal)
 {
     for (auto&& container: backwards(mContainerStack))
-        for (auto&& param: backwards(container->mParameters))
-            if (param.mName == nameIndex) {
-                isGlobal = container->isGlobal;
-                return &param;
-            }
+        if (ASTparameter* param = container->findParameter(nameIndex)) {
+            isGlobal = container->isGlobal;
+            return param;
+        }
     return nullptr;
 }
 
@@ -885,7 +892,9 @@ Builder::CheckVariableName(int index, const yy::location& loc, bool isParam)
 {
     if (mAllowOverlap && !isParam) return;
     
-    const ASTrepContainer* thisLevel = isParam ? &mParamDecls : mContainerStack.back();
+    ASTrepContainer* thisLevel = isParam ? &mParamDecls : mContainerStack.back();
+    if (thisLevel->isGlobal && !thisLevel->findParameter(index))
+        return;
     
     for (auto&& param: backwards(thisLevel->mParameters))
         if (param.mName == index) {
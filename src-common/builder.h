@@ -40,6 +40,7 @@
 #include <string>
 #include <cstdlib>
 #include <map>
+#include <unordered_set>
 #include <thread>
 #include <mutex>
 #include "agg2/agg_basics.h"
@@ -92,6 +93,11 @@ public:
     
     bool        mAllowOverlap;
     
+    // Names of the global variable definitions, indexed as the global body
+    // grows, see MakeDefinition()
+    std::unordered_set<std::string> mGlobalDefines;
+    std::size_t mGlobalDefinesSeen = 0;
+    
     using ContainerStack_t = std::vector<AST::ASTrepContainer*>;
     ContainerStack_t    mContainerStack;
     std::vector<int>     mStackStack;
@@ -52,6 +52,11 @@ yy::location CfdgError::Default;
 double Renderer::Infinity = std::numeric_limits<double>::infinity();      // Ignore the gcc warning
 std::atomic_bool Renderer::AbortEverything{false};
 unsigned Renderer::ParamCount = 0;
+bool Renderer::ParamStats = false;
+unsigned Renderer::ParamPeak = 0;
+unsigned long long Renderer::ParamAllocs = 0;
+std::size_t Renderer::ParamBytes = 0;
+std::array<unsigned long long, 8> Renderer::ParamSizes = {};
 const CfgArray<std::string> CFDG::ParamNames = {
     "CF::AllowOverlap",
     "CF::Alpha",
@@ -172,6 +177,12 @@ const std::array<const AbstractSystem::FileChar*, AbstractSystem::NumberofTempTy
 const std::array<const AbstractSystem::FileChar*, AbstractSystem::NumberofTempTypes> AbstractSystem::TempSuffixes = {
     FileStr(""), FileStr(""), FileStr(""), FileStr(".mov")
 };
+const std::array<const char*, AbstractSystem::Stats::NumberOfPhases> AbstractSystem::Stats::PhaseNames = {
+    "expand", "heap", "spill_write", "spill_read", "sort", "merge", "raster", "encode"
+};
+const std::array<const char*, AbstractSystem::Stats::NumberOfCounters> AbstractSystem::Stats::CounterNames = {
+    "cycles", "instructions", "llc_misses", "branch_misses"
+};
 const AbstractSystem::FileChar* AbstractSystem::TempPrefixAll = FileStr("cfdg-temp-");
 
 AbstractSystem::~AbstractSystem() = default;
@@ -349,3 +360,14 @@ CFDG::ParseFile(const char* fname, AbstractSystem* system, int variation,
 
 // Sketchy as fuck, I know
 #include "examples.h"
+
+int
+Renderer::ParamSizeBucket(int words)
+{
+    if (words <= 0)
+        return 0;
+    int bucket = 1;
+    for (int limit = 1; words > limit && bucket < 7; limit *= 2)
+        ++bucket;
+    return bucket;
+}
@@ -144,6 +144,37 @@ class AbstractSystem {
             int     outputDone = 0;     // number output so far
             std::clock_t outputTime = 0;
 
+            // Monotonic clock seconds spent in each render phase. Phases
+            // are exclusive: time spent sorting during a spill counts as
+            // sorting, not as spill writing.
+            enum Phase {
+                ExpandPhase, HeapPhase, SpillWritePhase, SpillReadPhase,
+                SortPhase, MergePhase, RasterPhase, EncodePhase, NumberOfPhases
+            };
+            static const std::array<const char*, NumberOfPhases> PhaseNames;
+            std::array<double, NumberOfPhases> phaseTime{};
+            bool    detailed = false;       // time each heap operation and drawn shape
+
+            // Hardware counter totals for each phase, exclusive like the
+            // times. Only collected with --perf-counters; counterMask has a
+            // bit set for each counter that was available.
+            enum Counter {
+                Cycles, Instructions, CacheMisses, BranchMisses, NumberOfCounters
+            };
+            static const std::array<const char*, NumberOfCounters> CounterNames;
+            std::array<std::array<double, NumberOfCounters>, NumberOfPhases> phaseCounters{};
+            unsigned counterMask = 0;
+
+            unsigned long long bytesSpilled = 0;    // bytes written to temp files
+            int     spillFiles = 0;
+            int     mergePasses = 0;
+            unsigned long long pathCacheHits = 0;
+            unsigned long long pathCacheMisses = 0;
+            unsigned long long paramInternHits = 0;     // parameter blocks shared
+            unsigned long long paramInternMisses = 0;
+            unsigned paramsLive = 0;        // parameter blocks in memory
+            unsigned paramsPeak = 0;
+
             bool    animating = false;      // inside the animation loop
             AbstractSystem* mSystem = nullptr;
 
@@ -180,6 +211,7 @@ class Canvas {
 
         virtual void primitive(int, RGBA8 , agg::trans_affine , agg::comp_op_e ) = 0;
         virtual void path(RGBA8, agg::trans_affine, const AST::CommandInfo& ) = 0;
+        virtual std::size_t bufferBytes() const { return 0; }   // pixel memory held
 
         Canvas(int width, int height) 
         : mWidth(width), mHeight(height), mError(false) {}
@@ -241,6 +273,8 @@ class Renderer {
         virtual ~Renderer();
         
         virtual void setMaxShapes(int n) = 0;        
+        // Relative error allowed when storing pending shapes compactly
+        virtual void setFrontierTolerance(double t) = 0;
         virtual void resetBounds() = 0;
         virtual void resetSize(int x, int y) = 0;
 
@@ -248,6 +282,27 @@ class Renderer {
         virtual void draw(Canvas* canvas) = 0;
         virtual void animate(Canvas* canvas, int frames, int frame, bool zoom) = 0;
 
+        virtual void setDetailedStats(bool on) = 0;
+        virtual bool startTrace(const std::string& path) = 0;
+        virtual bool startPerfCounters(std::string& error) = 0;
+
+        // Predicted cost of the render, from a short sample expansion
+        struct Estimate {
+            struct Range { double value = 0.0, low = 0.0, high = 0.0; };
+            bool    complete = false;       // the sample finished the design
+            double  sampleSeconds = 0.0;
+            double  sampleExpansions = 0.0;
+            double  sizeReached = 0.0;      // smallest shape expanded, pixels
+            double  minimumSize = 0.0;      // CF::MinimumSize, pixels
+            Range   shapes, expansions, frontier;
+            Range   memoryBytes, spillBytes, seconds;
+        };
+        virtual Estimate estimate(double sampleSeconds) = 0;
+        virtual void profileRules(bool on) = 0;
+        virtual void ruleProfile(std::ostream& table, std::ostream* folded) = 0;
+        virtual void sampleMemory(bool on) = 0;
+        virtual void memoryReport(std::ostream& out) = 0;
+
         std::atomic_bool requestStop;     // stop ASAP
         std::atomic_bool requestFinishUp; // stop expanding, and do final output
         std::atomic_bool requestUpdate;   // call stats() soon
@@ -259,6 +314,16 @@ class Renderer {
         static double Infinity;
         static std::atomic_bool   AbortEverything;
         static unsigned ParamCount;
+        // The counters below are only kept if ParamStats is set before the
+        // design is parsed
+        static bool ParamStats;
+        static unsigned ParamPeak;
+        static unsigned long long ParamAllocs;  // total parameter blocks allocated
+        static std::size_t ParamBytes;          // live parameter block bytes
+        // Parameter blocks allocated, by size in parameter words:
+        // 0, 1, 2, 3-4, 5-8, 9-16, 17-32, more
+        static std::array<unsigned long long, 8> ParamSizes;
+        static int ParamSizeBucket(int words);
     protected:
         Renderer(int w, int h);
 };
@@ -65,9 +65,8 @@ CFDGImpl::CFDGImpl(AbstractSystem* m)
         _unused(num);
     }
     
-    initVariables();
-    
     mCFDGcontents.isGlobal = true;
+    initVariables();
 #ifdef EXTREME_PARAM_DEBUG
     StackRule::ParamMap.clear();
     StackRule::ParamUID = 0;
@@ -516,34 +515,51 @@ CFDGImpl::decodeShapeLocation(int shapetype)
         return CfdgError::Default;
 }
 
+std::wstring
+CFDGImpl::canonicalName(const std::string& s) const
+{
+    // NFKC leaves ASCII alone, so only other names need the system
+    if (std::all_of(s.begin(), s.end(),
+                    [](char c) { return static_cast<unsigned char>(c) < 0x80; }))
+        return std::wstring(s.begin(), s.end());
+    return m_system->normalize(s);
+}
+
 int
 CFDGImpl::tryEncodeShapeName(const std::string& s) const
 {
-    std::wstring c = m_system->normalize(s);
-    return tryEncodeShapeName(c);
+    auto spelling = mSpellingIndex.find(s);
+    if (spelling != mSpellingIndex.end())
+        return spelling->second;
+    int i = tryEncodeShapeName(canonicalName(s));
+    if (i >= 0)
+        mSpellingIndex.emplace(s, i);
+    return i;
 }
 
 int
 CFDGImpl::tryEncodeShapeName(const std::wstring& s) const
 {
-    for (unsigned int i = 0; i < m_shapeTypes.size(); i++) {
-        if (s == m_shapeTypes[i].canonicalName) {
-            return i;
-        }
-    }
-    
-    return -1;
+    auto shape = mShapeIndex.find(s);
+    return shape == mShapeIndex.end() ? -1 : shape->second;
 }
 
 int
 CFDGImpl::encodeShapeName(const std::string& s, const yy::location& where)
 {
-    std::wstring c = m_system->normalize(s);
-    int i = tryEncodeShapeName(c);
-    if (i >= 0) return i;
+    auto spelling = mSpellingIndex.find(s);
+    if (spelling != mSpellingIndex.end())
+        return spelling->second;
 
-    m_shapeTypes.emplace_back(s, std::move(c), where);
-    return static_cast<int>(m_shapeTypes.size()) - 1;
+    std::wstring c = canonicalName(s);
+    int i = tryEncodeShapeName(c);
+    if (i < 0) {
+        i = static_cast<int>(m_shapeTypes.size());
+        mShapeIndex.emplace(c, i);
+        m_shapeTypes.emplace_back(s, std::move(c), where);
+    }
+    mSpellingIndex.emplace(s, i);
+    return i;
 }
 
 int
@@ -36,6 +36,7 @@
 #include <map>
 #include <deque>
 #include <type_traits>
+#include <unordered_map>
 
 #include "agg2/agg_color_rgba.h"
 #include "cfdg.h"
@@ -104,6 +105,11 @@ class CFDGImpl : public CFDG {
         };
         
         std::vector<ShapeType> m_shapeTypes;
+        // Shape numbers by canonical name and by the name as written, so
+        // that each spelling is only normalized once
+        std::unordered_map<std::wstring, int> mShapeIndex;
+        mutable std::unordered_map<std::string, int> mSpellingIndex;
+        std::wstring canonicalName(const std::string& s) const;
     
         void initVariables();
     
@@ -110,6 +110,9 @@ CommandLineSystem::openFileForRead(const std::string& path)
 void
 CommandLineSystem::stats(const Stats& s)
 {
+    mLastStats = s;
+    mLastStats.mSystem = nullptr;   // don't cancel progress when destroyed
+    
     if (mQuiet || mErrorMode) return;
     
     if (s.inOutput || s.showProgress) {
@@ -64,8 +64,10 @@ public:
     
     void stats(const Stats&) override;
     void orphan() override {};
+    const Stats& lastStats() const { return mLastStats; }
 private:
     std::vector<char> buf;
+    Stats mLastStats;
 };
 
 #undef CLI_SYSTEM_BASE
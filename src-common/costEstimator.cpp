@@ -0,0 +1,159 @@
+// costEstimator.cpp
+// this file is part of Context Free
+// ---------------------
+// Copyright (C) 2026 John Horigan - john@glyphic.com
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+// John Horigan can be contacted at john@glyphic.com or at
+// John Horigan, 1209 Villa St., Mountain View, CA 94041-1123, USA
+//
+//
+
+
+
+#include "costEstimator.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // Keeps exp() finite; the counts are capped by CF::MaxShapes anyway
+    const double MaxExponent = 600.0;
+    // Checkpoints are at least a factor of 2 in area apart, generations
+    // that are further apart than this show up as wider gaps
+    const double CoarseSteps = std::log(2.2);
+}
+
+void
+CostEstimator::checkpoint(double area, const Counts& counts, double seconds)
+{
+    if (!(area > 0.0) || !std::isfinite(area))
+        return;
+    mPoints.push_back({-std::log(area), counts, seconds});
+    mNextArea = area * 0.5;
+}
+
+double
+CostEstimator::lastArea() const
+{
+    return mPoints.empty() ? 0.0 : std::exp(-mPoints.back().logScale);
+}
+
+// Fit over the checkpoints in the second half of the sampled scale range,
+// but at least the last three
+std::size_t
+CostEstimator::fitStart() const
+{
+    if (mPoints.size() <= 3)
+        return 0;
+    double mid = (mPoints.front().logScale + mPoints.back().logScale) * 0.5;
+    std::size_t start = 0;
+    while (start < mPoints.size() - 3 && mPoints[start].logScale < mid)
+        ++start;
+    return start;
+}
+
+CostEstimator::Range
+CostEstimator::extrapolate(Quantity q, double minArea, double lowest) const
+{
+    Range r;
+    if (mPoints.empty())
+        return r;
+    const Point& last = mPoints.back();
+    double end = last.counts[q];
+    double distance = (minArea > 0.0) ? -std::log(minArea) - last.logScale : 0.0;
+    if (!(distance > 0.0) || end <= 0.0) {
+        r.value = r.low = r.high = std::max(end, lowest);
+        return r;
+    }
+
+    // Least squares fit of log(count) against log(1/area)
+    double n = 0.0, sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+    std::size_t start = fitStart();
+    for (std::size_t i = start; i < mPoints.size(); ++i) {
+        double v = mPoints[i].counts[q];
+        if (v <= 0.0)
+            continue;
+        double x = mPoints[i].logScale, y = std::log(v);
+        n += 1.0; sx += x; sy += y; sxx += x * x; sxy += x * y;
+    }
+    double slope, low, high;
+    double det = n * sxx - sx * sx;
+    if (n < 2.0 || det <= 0.0) {
+        // Nothing to fit, assume anything from no growth to filling the plane
+        slope = 0.5;
+        low = 0.0;
+        high = 1.0;
+    } else {
+        slope = (n * sxy - sx * sy) / det;
+        double intercept = (sy - slope * sx) / n;
+        double residual = 0.0;
+        for (std::size_t i = start; i < mPoints.size(); ++i) {
+            double v = mPoints[i].counts[q];
+            if (v <= 0.0)
+                continue;
+            double e = std::log(v) - intercept - slope * mPoints[i].logScale;
+            residual += e * e;
+        }
+        double se = (n > 2.0) ? std::sqrt(residual / (n - 2.0) * n / det) : 0.5 * std::fabs(slope);
+        low = slope - 2.0 * se;
+        high = slope + 2.0 * se;
+        if (mPoints.size() >= 2) {
+            const Point& prev = mPoints[mPoints.size() - 2];
+            double dx = last.logScale - prev.logScale;
+            if (dx > 0.0 && prev.counts[q] > 0.0) {
+                double recent = std::log(end / prev.counts[q]) / dx;
+                low = std::min(low, recent);
+                high = std::max(high, recent);
+            }
+        }
+        slope = std::max(slope, 0.0);
+        low = std::max(low, 0.0);
+        high = std::max(high, slope);
+    }
+
+    // Designs with a few fixed scales grow in steps: all the shapes of one
+    // generation have the same area. If the generations are further apart
+    // than the checkpoints, the minimum size can fall anywhere within a
+    // step, so the estimate is the middle of the step and the bounds span it.
+    double step = 0.0;
+    std::vector<double> gaps;
+    for (std::size_t i = std::max<std::size_t>(start, 1); i < mPoints.size(); ++i)
+        gaps.push_back(mPoints[i].logScale - mPoints[i - 1].logScale);
+    if (!gaps.empty()) {
+        std::nth_element(gaps.begin(), gaps.begin() + gaps.size() / 2, gaps.end());
+        if (gaps[gaps.size() / 2] > CoarseSteps)
+            step = gaps[gaps.size() / 2];
+    }
+
+    auto grow = [&](double k, double extra) {
+        return end * std::exp(std::min(k * (distance + extra), MaxExponent));
+    };
+    r.value = std::max(grow(slope, step * 0.5), lowest);
+    r.low = std::max(grow(low, 0.0), lowest);
+    r.high = std::max(grow(high, step), r.value);
+    return r;
+}
+
+double
+CostEstimator::expansionSeconds() const
+{
+    if (mPoints.size() < 2)
+        return 0.0;
+    const Point& first = mPoints[std::min(fitStart(), mPoints.size() - 2)];
+    const Point& last = mPoints.back();
+    double expansions = last.counts[Expansions] - first.counts[Expansions];
+    return expansions > 0.0 ? (last.seconds - first.seconds) / expansions : 0.0;
+}
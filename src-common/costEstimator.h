@@ -0,0 +1,82 @@
+// costEstimator.h
+// this file is part of Context Free
+// ---------------------
+// Copyright (C) 2026 John Horigan - john@glyphic.com
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+// John Horigan can be contacted at john@glyphic.com or at
+// John Horigan, 1209 Villa St., Mountain View, CA 94041-1123, USA
+//
+//
+
+
+
+
+#ifndef INCLUDE_COSTESTIMATOR_H
+#define INCLUDE_COSTESTIMATOR_H
+
+#include "cfdg.h"
+#include <array>
+#include <limits>
+#include <vector>
+
+// Extrapolates the cost of a full render from a short sample expansion, for
+// --estimate. The renderer expands the largest shape first, so stopping a
+// render early is the same as expanding it down to a coarser minimum size.
+// The sample records checkpoints as the expanded shape area drops by
+// factors of two. For a self-similar design the counts grow as a power of
+// the inverse area, so a power law is fitted to the later checkpoints and
+// extrapolated down to the real minimum size. The bounds are the fit's
+// slope plus or minus two standard errors, also covering the slope of the
+// last few checkpoints, widened by a generation for designs whose shapes
+// come in a few fixed sizes. Designs that stop by recursion depth rather
+// than by size grow more slowly than the fit, so they are overestimated.
+
+class CostEstimator
+{
+public:
+    using Range = Renderer::Estimate::Range;
+    enum Quantity { Expansions, Finished, Frontier, NumQuantities };
+    using Counts = std::array<double, NumQuantities>;
+
+    // True if a shape of this (world) area is due for a checkpoint
+    bool wants(double area) const { return area <= mNextArea; }
+    // Record the counts before expanding a shape of this area
+    void checkpoint(double area, const Counts& counts, double seconds);
+
+    bool empty() const { return mPoints.empty(); }
+    double lastArea() const;
+
+    // Extrapolate a count to the given minimum area; lowest is a known
+    // lower bound for the result
+    Range extrapolate(Quantity q, double minArea, double lowest) const;
+
+    // Seconds per expansion over the fitted checkpoints
+    double expansionSeconds() const;
+
+private:
+    struct Point {
+        double  logScale;       // log of inverse area
+        Counts  counts;
+        double  seconds;
+    };
+    std::size_t fitStart() const;
+
+    std::vector<Point>  mPoints;
+    double              mNextArea = std::numeric_limits<double>::infinity();
+};
+
+#endif // INCLUDE_COSTESTIMATOR_H
@@ -0,0 +1,436 @@
+// exprCache.cpp
+// this file is part of Context Free
+// ---------------------
+// Copyright (C) 2026 John Horigan - john@glyphic.com
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+// John Horigan can be contacted at john@glyphic.com or at
+// John Horigan, 1209 Villa St., Mountain View, CA 94041-1123, USA
+//
+//
+
+
+
+#include "astreplacement.h"
+#include "astexpression.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+#include <typeinfo>
+#include <vector>
+
+// The values of a rule body's variables never change once they are on the
+// stack, so a pure expression is invariant over a loop if it only refers to
+// parameters, globals and variables below the loop index, and over a rule
+// body if it only refers to parameters and globals. Other local variables
+// are told apart by their stack position from type check. Random and time
+// functions and let expressions are never cached.
+
+namespace {
+    using namespace AST;
+    
+    struct Scope {
+        ASTrepContainer* mBody;             // rule body or loop body
+        int mBoundary;                      // other locals below this are invariant
+        int mIndex;                         // loop index, -1 for a rule body
+        std::map<std::string, std::pair<unsigned, unsigned>> mSlots;
+    };
+    
+    struct Site {
+        exp_ptr* mExp;
+        std::string mKey;
+        int mCount;
+        std::size_t mOwner;
+        bool mPerIteration;
+        bool mHoisted;                      // cached even if not repeated
+        std::vector<std::size_t> mChain;    // scopes that enclose it
+        long mParent;                       // enclosing site, or -1
+        bool mCached = false;
+    };
+    
+    struct Description {
+        std::string mKey;
+        int mMaxLocal = -1;                 // highest non-parameter local
+        int mCalls = 0;
+        int mOperators = 0;
+    };
+    
+    class Planner {
+    public:
+        explicit Planner(ASTrule& rule);
+        
+    private:
+        std::vector<Scope> mScopes;
+        std::vector<std::size_t> mActive;
+        std::vector<Site> mSites;
+        long mParent = -1;
+        
+        void container(ASTrepContainer& c);
+        void replacement(ASTreplacement& r);
+        void modification(ASTmodification& m);
+        void expression(exp_ptr& e);
+        void children(ASTexpression* e);
+        bool classify(const Description& d, Site& site) const;
+        void finish();
+        
+        static bool describe(const ASTexpression* e, Description& d,
+                             std::set<const ASTdefine*>& functions);
+        static bool pureFunction(const ASTdefine* def,
+                                 std::set<const ASTdefine*>& functions);
+    };
+    
+    Planner::Planner(ASTrule& rule)
+    {
+        mScopes.push_back({&rule.mRuleBody, 0, -1, {}});
+        mActive.push_back(0);
+        for (auto& rep: rule.mRuleBody.mBody)
+            replacement(*rep);
+        finish();
+    }
+    
+    void
+    Planner::container(ASTrepContainer& c)
+    {
+        for (auto& rep: c.mBody)
+            replacement(*rep);
+    }
+    
+    void
+    Planner::replacement(ASTreplacement& r)
+    {
+        if (auto loop = dynamic_cast<ASTloop*>(&r)) {
+            expression(loop->mLoopArgs);
+            if (loop->mIndexStackIndex >= 0) {
+                int index = loop->mIndexStackIndex;
+                mScopes.push_back({&loop->mLoopBody, index, index, {}});
+                mActive.push_back(mScopes.size() - 1);
+                modification(loop->mChildChange);
+                container(loop->mLoopBody);
+                mActive.pop_back();
+            }
+            container(loop->mFinallyBody);
+        } else if (auto trans = dynamic_cast<ASTtransform*>(&r)) {
+            // Only the adjustments in a transform list, symmetry specs are
+            // examined by getTransforms()
+            if (auto mod = dynamic_cast<ASTmodification*>(trans->mExpHolder.get())) {
+                modification(*mod);
+            } else if (auto list = dynamic_cast<ASTcons*>(trans->mExpHolder.get())) {
+                for (auto& kid: list->children)
+                    if (auto mod = dynamic_cast<ASTmodification*>(kid.get()))
+                        modification(*mod);
+            }
+            container(trans->mBody);
+        } else if (auto ifRep = dynamic_cast<ASTif*>(&r)) {
+            expression(ifRep->mCondition);
+            container(ifRep->mThenBody);
+            container(ifRep->mElseBody);
+        } else if (auto switchRep = dynamic_cast<ASTswitch*>(&r)) {
+            expression(switchRep->mSwitchExp);
+            for (auto& caseRep: switchRep->mCases)
+                if (caseRep.second)
+                    container(*caseRep.second);
+            container(switchRep->mElseBody);
+        } else if (auto def = dynamic_cast<ASTdefine*>(&r)) {
+            if (def->mDefineType != ASTdefine::StackDefine)
+                return;
+            if (def->mType == NumericType)
+                expression(def->mExpression);
+            else if (def->mType == ModType)
+                modification(def->mChildChange);
+        } else if (auto pathOp = dynamic_cast<ASTpathOp*>(&r)) {
+            expression(pathOp->mArguments);
+            modification(pathOp->mChildChange);
+        } else if (auto command = dynamic_cast<ASTpathCommand*>(&r)) {
+            expression(command->mParameters);
+            modification(command->mChildChange);
+        } else if (typeid(r) == typeid(ASTreplacement)) {
+            if (r.mShapeSpec.argSource == ASTruleSpecifier::DynamicArgs ||
+                r.mShapeSpec.argSource == ASTruleSpecifier::ShapeArgs)
+                expression(r.mShapeSpec.arguments);
+            modification(r.mChildChange);
+        }
+    }
+    
+    void
+    Planner::modification(ASTmodification& m)
+    {
+        for (auto& term: m.modExp) {
+            if (!term->args)
+                continue;
+            if (auto mod = dynamic_cast<ASTmodification*>(term->args.get()))
+                modification(*mod);
+            else if (term->args->mType == NumericType)
+                expression(term->args);
+        }
+    }
+    
+    void
+    Planner::expression(exp_ptr& e)
+    {
+        if (!e)
+            return;
+        if (e->mType == NumericType && !e->isConstant &&
+            !dynamic_cast<ASTcons*>(e.get()))
+        {
+            Description d;
+            std::set<const ASTdefine*> functions;
+            Site site;
+            if (describe(e.get(), d, functions) &&
+                (d.mCalls > 0 || d.mOperators > 1) && classify(d, site))
+            {
+                site.mExp = &e;
+                site.mKey = std::move(d.mKey);
+                try {
+                    site.mCount = e->evaluate();
+                } catch (DeferUntilRuntime&) {
+                    return;
+                } catch (CfdgError&) {
+                    return;
+                }
+                site.mChain = mActive;
+                site.mParent = mParent;
+                if (site.mCount < 1 || site.mCount > AST::MaxVectorSize)
+                    return;
+                mSites.push_back(std::move(site));
+                if (mSites.back().mHoisted)
+                    return;
+                // Parts of a repeated expression may be invariant
+                long parent = mParent;
+                mParent = static_cast<long>(mSites.size()) - 1;
+                children(e.get());
+                mParent = parent;
+                return;
+            }
+        }
+        children(e.get());
+    }
+    
+    void
+    Planner::children(ASTexpression* e)
+    {
+        if (auto list = dynamic_cast<ASTcons*>(e)) {
+            for (auto& kid: list->children)
+                expression(kid);
+        } else if (auto func = dynamic_cast<ASTfunction*>(e)) {
+            expression(func->arguments);
+        } else if (auto op = dynamic_cast<ASToperator*>(e)) {
+            expression(op->left);
+            expression(op->right);
+        } else if (auto paren = dynamic_cast<ASTparen*>(e)) {
+            expression(paren->e);
+        } else if (auto sel = dynamic_cast<ASTselect*>(e)) {
+            expression(sel->selector);
+            for (auto& arg: sel->arguments)
+                expression(arg);
+        } else if (auto mod = dynamic_cast<ASTmodification*>(e)) {
+            modification(*mod);
+        } else if (auto func = dynamic_cast<ASTuserFunction*>(e)) {
+            if (!dynamic_cast<ASTlet*>(e))
+                expression(func->arguments);
+        }
+    }
+    
+    bool
+    Planner::classify(const Description& d, Site& site) const
+    {
+        std::size_t depth = mActive.size() - 1;     // loops enclosing the site
+        for (std::size_t k = 0; k <= depth; ++k) {
+            if (d.mMaxLocal < mScopes[mActive[k]].mBoundary) {
+                // Worth caching over a loop, or within a rule body if repeated
+                site.mOwner = mActive[k];
+                site.mPerIteration = false;
+                site.mHoisted = depth > 0;
+                return true;
+            }
+        }
+        if (depth > 0 && d.mMaxLocal <= mScopes[mActive[depth]].mIndex) {
+            site.mOwner = mActive[depth];
+            site.mPerIteration = true;
+            site.mHoisted = false;
+            return true;
+        }
+        return false;
+    }
+    
+    bool
+    Planner::describe(const ASTexpression* e, Description& d,
+                      std::set<const ASTdefine*>& functions)
+    {
+        if (!e || e->mType != NumericType)
+            return false;
+        
+        if (auto real = dynamic_cast<const ASTreal*>(e)) {
+            std::uint64_t bits;
+            std::memcpy(&bits, &real->value, sizeof(bits));
+            d.mKey.append("r").append(std::to_string(bits));
+            return true;
+        }
+        if (auto var = dynamic_cast<const ASTvariable*>(e)) {
+            if (var->stackIndex == ASTvariable::IllegalStackIndex)
+                return false;
+            if (var->stackIndex >= 0) {
+                d.mKey.append("g").append(std::to_string(var->stackIndex));
+            } else {
+                if (var->bound.mStackIndex < 0)
+                    return false;
+                d.mKey.append("l").append(std::to_string(var->bound.mStackIndex));
+                if (!var->isParameter)
+                    d.mMaxLocal = std::max(d.mMaxLocal, var->bound.mStackIndex + var->count - 1);
+            }
+            d.mKey.append(":").append(std::to_string(var->count));
+            return true;
+        }
+        if (auto func = dynamic_cast<const ASTfunction*>(e)) {
+            // Random functions change the seed, ftime() and frame() are
+            // left alone as well
+            if (func->functype >= ASTfunction::Ftime)
+                return false;
+            ++d.mCalls;
+            d.mKey.append("f").append(std::to_string(func->functype)).append("(");
+            if (func->arguments && !describe(func->arguments.get(), d, functions))
+                return false;
+            d.mKey.append(")");
+            return true;
+        }
+        if (auto op = dynamic_cast<const ASToperator*>(e)) {
+            ++d.mOperators;
+            d.mKey.append("o").append(1, op->op).append("(");
+            if (!describe(op->left.get(), d, functions))
+                return false;
+            if (op->right) {
+                d.mKey.append(",");
+                if (!describe(op->right.get(), d, functions))
+                    return false;
+            }
+            d.mKey.append(")");
+            return true;
+        }
+        if (auto paren = dynamic_cast<const ASTparen*>(e))
+            return describe(paren->e.get(), d, functions);
+        if (auto list = dynamic_cast<const ASTcons*>(e)) {
+            d.mKey.append("[");
+            for (auto& kid: list->children) {
+                if (!describe(kid.get(), d, functions))
+                    return false;
+                d.mKey.append(",");
+            }
+            d.mKey.append("]");
+            return true;
+        }
+        if (auto sel = dynamic_cast<const ASTselect*>(e)) {
+            ++d.mCalls;
+            d.mKey.append(sel->ifSelect ? "i(" : "s(");
+            if (!describe(sel->selector.get(), d, functions))
+                return false;
+            for (auto& arg: sel->arguments) {
+                d.mKey.append(",");
+                if (!describe(arg.get(), d, functions))
+                    return false;
+            }
+            d.mKey.append(")");
+            return true;
+        }
+        if (auto func = dynamic_cast<const ASTuserFunction*>(e)) {
+            if (dynamic_cast<const ASTlet*>(e) || !func->definition ||
+                !pureFunction(func->definition, functions))
+                return false;
+            ++d.mCalls;
+            d.mKey.append("u").append(std::to_string(func->nameIndex)).append("(");
+            if (func->arguments && !describe(func->arguments.get(), d, functions))
+                return false;
+            d.mKey.append(")");
+            return true;
+        }
+        return false;
+    }
+    
+    bool
+    Planner::pureFunction(const ASTdefine* def, std::set<const ASTdefine*>& functions)
+    {
+        // The body only sees the function's own parameters and globals, so
+        // its variables do not matter. Recursive functions are not cached.
+        if (def->mDefineType != ASTdefine::FunctionDefine || !def->mExpression ||
+            !functions.insert(def).second)
+            return false;
+        Description body;
+        bool pure = describe(def->mExpression.get(), body, functions);
+        functions.erase(def);
+        return pure;
+    }
+    
+    void
+    Planner::finish()
+    {
+        // Repeated expressions are only cached if they are not already part
+        // of a cached expression
+        std::map<std::pair<std::size_t, std::string>, int> repeats;
+        for (const Site& site: mSites)
+            if (!site.mHoisted)
+                ++repeats[{site.mOwner, site.mKey}];
+        for (Site& site: mSites) {
+            bool inCached = false;
+            for (long p = site.mParent; p >= 0; p = mSites[p].mParent)
+                inCached = inCached || mSites[p].mCached;
+            if (site.mHoisted) {
+                site.mCached = true;
+            } else if (inCached) {
+                --repeats[{site.mOwner, site.mKey}];
+            } else {
+                site.mCached = repeats[{site.mOwner, site.mKey}] > 1;
+            }
+            if (!site.mCached)
+                continue;
+            Scope& owner = mScopes[site.mOwner];
+            auto slot = owner.mSlots.find(site.mKey);
+            if (slot == owner.mSlots.end()) {
+                slot = owner.mSlots.emplace(site.mKey,
+                    std::make_pair(owner.mBody->mCacheSlots, owner.mBody->mCacheValues)).first;
+                ++owner.mBody->mCacheSlots;
+                owner.mBody->mCacheValues += static_cast<unsigned>(site.mCount);
+            }
+        }
+        
+        // Children before parents, so that the pointers to them stay valid
+        for (auto it = mSites.rbegin(); it != mSites.rend(); ++it) {
+            if (!it->mCached)
+                continue;
+            auto cached = std::make_unique<ASTcached>(std::move(*it->mExp), it->mCount);
+            const Scope& owner = mScopes[it->mOwner];
+            std::tie(cached->mSlot, cached->mOffset) = owner.mSlots.at(it->mKey);
+            cached->mPerIteration = it->mPerIteration;
+            // Only scopes with cached expressions push a frame
+            bool inside = false;
+            for (std::size_t scope: it->mChain) {
+                if (inside && mScopes[scope].mBody->mCacheSlots)
+                    ++cached->mFrame;
+                inside = inside || scope == it->mOwner;
+            }
+            *it->mExp = std::move(cached);
+        }
+    }
+}
+
+namespace AST {
+    void
+    CacheExpressions(ASTrule& rule)
+    {
+        Planner plan(rule);
+    }
+}
@@ -0,0 +1,284 @@
+// frontier.cpp
+// this file is part of Context Free
+// ---------------------
+// Copyright (C) 2026 John Horigan - john@glyphic.com
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+// John Horigan can be contacted at john@glyphic.com or at
+// John Horigan, 1209 Villa St., Mountain View, CA 94041-1123, USA
+//
+//
+
+
+
+#include "frontier.h"
+#include <cmath>
+#include <cstring>
+#include <new>
+
+// Record layout: the Record header, then the stored parts in order
+// (geometry, z, time, color) as halves, floats or doubles, padded to 8
+// bytes. Halves are the top 16 bits of a float (bfloat16), which keeps the
+// float exponent range with a relative error of at most 2^-9.
+
+namespace {
+    enum Part : unsigned { Geometry, Depth, Time, Color, PartCount };
+    const std::size_t PartValues[PartCount] = { 6, 2, 3, 8 };
+    const std::size_t MaxValues = 8;
+
+    void
+    gather(const Modification& m, unsigned part, double* v)
+    {
+        switch (part) {
+            case Geometry:
+                v[0] = m.m_transform.sx;  v[1] = m.m_transform.shy;
+                v[2] = m.m_transform.shx; v[3] = m.m_transform.sy;
+                v[4] = m.m_transform.tx;  v[5] = m.m_transform.ty;
+                break;
+            case Depth:
+                v[0] = m.m_Z.sz; v[1] = m.m_Z.tz;
+                break;
+            case Time:
+                v[0] = m.m_time.st; v[1] = m.m_time.tbegin; v[2] = m.m_time.tend;
+                break;
+            default:
+                v[0] = m.m_Color.h; v[1] = m.m_Color.s;
+                v[2] = m.m_Color.b; v[3] = m.m_Color.a;
+                v[4] = m.m_ColorTarget.h; v[5] = m.m_ColorTarget.s;
+                v[6] = m.m_ColorTarget.b; v[7] = m.m_ColorTarget.a;
+                break;
+        }
+    }
+
+    void
+    scatter(Modification& m, unsigned part, const double* v)
+    {
+        switch (part) {
+            case Geometry:
+                m.m_transform.sx = v[0];  m.m_transform.shy = v[1];
+                m.m_transform.shx = v[2]; m.m_transform.sy = v[3];
+                m.m_transform.tx = v[4];  m.m_transform.ty = v[5];
+                break;
+            case Depth:
+                m.m_Z.sz = v[0]; m.m_Z.tz = v[1];
+                break;
+            case Time:
+                m.m_time.st = v[0]; m.m_time.tbegin = v[1]; m.m_time.tend = v[2];
+                break;
+            default:
+                m.m_Color.h = v[0]; m.m_Color.s = v[1];
+                m.m_Color.b = v[2]; m.m_Color.a = v[3];
+                m.m_ColorTarget.h = v[4]; m.m_ColorTarget.s = v[5];
+                m.m_ColorTarget.b = v[6]; m.m_ColorTarget.a = v[7];
+                break;
+        }
+    }
+
+    const std::size_t ValueBytes[] = { 0, sizeof(std::uint16_t), sizeof(float), sizeof(double) };
+
+    std::uint16_t
+    toHalf(double v)
+    {
+        float f = static_cast<float>(v);
+        std::uint32_t u;
+        std::memcpy(&u, &f, sizeof(float));
+        if ((u & 0x7f800000) != 0x7f800000)
+            u += 0x7fff + ((u >> 16) & 1);      // round to nearest even
+        return static_cast<std::uint16_t>(u >> 16);
+    }
+
+    double
+    fromHalf(std::uint16_t h)
+    {
+        std::uint32_t u = static_cast<std::uint32_t>(h) << 16;
+        float f;
+        std::memcpy(&f, &u, sizeof(float));
+        return f;
+    }
+
+    // Values are compared bitwise so that -0.0 and NaNs survive the trip
+    bool
+    fits(double v, double coded, double tolerance)
+    {
+        if (std::memcmp(&coded, &v, sizeof(double)) == 0)
+            return true;
+        return tolerance > 0.0 && std::fabs(coded - v) <= tolerance * std::fabs(v);
+    }
+}
+
+FrontierStore::Entry
+FrontierStore::put(Shape&& s)
+{
+    double values[PartCount][MaxValues];
+    unsigned layout = 0;
+    std::size_t payload = 0;
+    for (unsigned p = 0; p < PartCount; ++p) {
+        double ref[MaxValues];
+        gather(s.mWorldState, p, values[p]);
+        gather(mReference, p, ref);
+        std::size_t n = PartValues[p];
+        if (std::memcmp(values[p], ref, n * sizeof(double)) == 0)
+            continue;
+        // The narrowest encoding that every value of the part fits
+        unsigned encoding = Halves;
+        for (std::size_t i = 0; i < n && encoding != Doubles; ++i) {
+            double v = values[p][i];
+            if (encoding == Halves && !fits(v, fromHalf(toHalf(v)), mTolerance))
+                encoding = Floats;
+            if (encoding == Floats &&
+                !fits(v, static_cast<double>(static_cast<float>(v)), mTolerance))
+                encoding = Doubles;
+        }
+        layout |= encoding << (2 * p);
+        payload += n * ValueBytes[encoding];
+    }
+
+    std::size_t size = (sizeof(Record) + payload + 7) & ~static_cast<std::size_t>(7);
+    std::uint32_t index = static_cast<std::uint32_t>(size >> 3);
+    if (mPools.size() <= index)
+        mPools.resize(index + 1);
+    Pool& pool = mPools[index];
+    pool.mSize = size;
+
+    std::uint32_t slot;
+    if (pool.mFree != NoSlot) {
+        slot = pool.mFree;
+        std::memcpy(&pool.mFree, pool.at(slot), sizeof(std::uint32_t));
+    } else {
+        if ((pool.mUsed >> ChunkPower) == pool.mChunks.size())
+            pool.mChunks.emplace_back(new char[ChunkSize * size]);
+        slot = pool.mUsed++;
+    }
+    mBytes += size;
+
+    char* rec = pool.at(slot);
+    new (rec) Record{std::move(s.mParameters), s.mWorldState.mRand64Seed,
+                     s.mShapeType, s.mWorldState.m_BlendMode,
+                     s.mWorldState.m_ColorAssignment, layout};
+    char* data = rec + sizeof(Record);
+    for (unsigned p = 0; p < PartCount; ++p) {
+        unsigned encoding = (layout >> (2 * p)) & 3;
+        std::size_t n = PartValues[p];
+        if (encoding == Halves) {
+            for (std::size_t i = 0; i < n; ++i) {
+                std::uint16_t h = toHalf(values[p][i]);
+                std::memcpy(data, &h, sizeof(std::uint16_t));
+                data += sizeof(std::uint16_t);
+            }
+        } else if (encoding == Floats) {
+            for (std::size_t i = 0; i < n; ++i) {
+                float f = static_cast<float>(values[p][i]);
+                std::memcpy(data, &f, sizeof(float));
+                data += sizeof(float);
+            }
+        } else if (encoding == Doubles) {
+            std::memcpy(data, values[p], n * sizeof(double));
+            data += n * sizeof(double);
+        }
+    }
+
+    Entry e;
+    e.mArea = s.mAreaCache;
+    e.mSlot = slot;
+    e.mPool = index;
+    return e;
+}
+
+void
+FrontierStore::decode(const char* rec, Shape& s) const
+{
+    const Record* r = reinterpret_cast<const Record*>(rec);
+    s.mShapeType = r->mShapeType;
+    s.mWorldState = mReference;
+    s.mWorldState.mRand64Seed = r->mRand64Seed;
+    s.mWorldState.m_BlendMode = r->mBlendMode;
+    s.mWorldState.m_ColorAssignment = r->mColorAssignment;
+
+    const char* data = rec + sizeof(Record);
+    for (unsigned p = 0; p < PartCount; ++p) {
+        unsigned encoding = (r->mLayout >> (2 * p)) & 3;
+        std::size_t n = PartValues[p];
+        double values[MaxValues];
+        if (encoding == Halves) {
+            for (std::size_t i = 0; i < n; ++i) {
+                std::uint16_t h;
+                std::memcpy(&h, data, sizeof(std::uint16_t));
+                values[i] = fromHalf(h);
+                data += sizeof(std::uint16_t);
+            }
+        } else if (encoding == Floats) {
+            for (std::size_t i = 0; i < n; ++i) {
+                float f;
+                std::memcpy(&f, data, sizeof(float));
+                values[i] = f;
+                data += sizeof(float);
+            }
+        } else if (encoding == Doubles) {
+            std::memcpy(values, data, n * sizeof(double));
+            data += n * sizeof(double);
+        } else {
+            continue;
+        }
+        scatter(s.mWorldState, p, values);
+    }
+}
+
+void
+FrontierStore::free(Pool& pool, std::uint32_t slot, char* rec)
+{
+    reinterpret_cast<Record*>(rec)->~Record();
+    std::memcpy(rec, &pool.mFree, sizeof(std::uint32_t));
+    pool.mFree = slot;
+    mBytes -= pool.mSize;
+}
+
+Shape
+FrontierStore::take(const Entry& e)
+{
+    Pool& pool = mPools[e.mPool];
+    char* rec = pool.at(e.mSlot);
+    Shape s;
+    decode(rec, s);
+    s.mParameters = std::move(reinterpret_cast<Record*>(rec)->mParameters);
+    s.mAreaCache = e.mArea;
+    free(pool, e.mSlot, rec);
+    return s;
+}
+
+Shape
+FrontierStore::peek(const Entry& e) const
+{
+    const char* rec = mPools[e.mPool].at(e.mSlot);
+    Shape s;
+    decode(rec, s);
+    s.mParameters = reinterpret_cast<const Record*>(rec)->mParameters;
+    s.mAreaCache = e.mArea;
+    return s;
+}
+
+void
+FrontierStore::erase(const Entry& e)
+{
+    Pool& pool = mPools[e.mPool];
+    free(pool, e.mSlot, pool.at(e.mSlot));
+}
+
+void
+FrontierStore::clear()
+{
+    mPools.clear();
+    mBytes = 0;
+}
@@ -0,0 +1,118 @@
+// frontier.h
+// this file is part of Context Free
+// ---------------------
+// Copyright (C) 2026 John Horigan - john@glyphic.com
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+// John Horigan can be contacted at john@glyphic.com or at
+// John Horigan, 1209 Villa St., Mountain View, CA 94041-1123, USA
+//
+//
+
+
+
+
+#ifndef INCLUDE_FRONTIER_H
+#define INCLUDE_FRONTIER_H
+
+#include "shape.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Compact storage for the shapes waiting to be expanded. The frontier heap
+// only holds an Entry (area and slot), the rest of the shape is encoded in
+// a pool of fixed-size records. Each part of the world state (geometry, z,
+// time and color) is left out if it matches the reference shape, or else
+// stored as 16 bit halves, floats or doubles, whichever is the narrowest
+// that keeps every value within the tolerance. With the default tolerance
+// of zero a narrower encoding is only used if it is exact, so decoding
+// gives back the original shape.
+
+class FrontierStore {
+public:
+    struct Entry {
+        double          mArea = 0.0;
+        std::uint32_t   mSlot = 0;
+        std::uint32_t   mPool = 0;
+
+        double area() const { return mArea; }
+        bool operator<(const Entry& o) const { return mArea < o.mArea; }
+    };
+
+    FrontierStore() = default;
+    FrontierStore(const FrontierStore&) = delete;
+    FrontierStore& operator=(const FrontierStore&) = delete;
+
+    // Parts equal to the reference are not stored. The reference can only
+    // change while the store is empty.
+    void setReference(const Modification& m)
+    { if (mBytes == 0) mReference = m; }
+    // Maximum relative error of a value stored as a half or float
+    void setTolerance(double t) { mTolerance = t; }
+    double tolerance() const { return mTolerance; }
+
+    Entry put(Shape&& s);
+    Shape take(const Entry& e);         // decode and free
+    Shape peek(const Entry& e) const;   // decode a copy
+    void  erase(const Entry& e);
+
+    // Every entry must have been taken or erased first
+    void clear();
+
+    std::size_t bytes() const { return mBytes; }   // of live records
+
+private:
+    enum : unsigned {
+        ChunkPower = 12, ChunkSize = 1 << ChunkPower,
+        NoSlot = UINT32_MAX
+    };
+    // Part encodings, two bits per part in Record::mLayout
+    enum : unsigned { Elided = 0, Halves = 1, Floats = 2, Doubles = 3 };
+
+    struct Record {
+        param_ptr       mParameters;
+        Rand64          mRand64Seed;
+        int             mShapeType;
+        int             mBlendMode;
+        unsigned        mColorAssignment;
+        unsigned        mLayout;
+    };
+
+    struct Pool {
+        std::size_t     mSize = 0;      // bytes per record
+        std::vector<std::unique_ptr<char[]>> mChunks;
+        std::uint32_t   mUsed = 0;
+        std::uint32_t   mFree = NoSlot;
+
+        char* at(std::uint32_t slot) const
+        {
+            return mChunks[slot >> ChunkPower].get() +
+                   (slot & (ChunkSize - 1)) * mSize;
+        }
+    };
+
+    Modification        mReference;
+    double              mTolerance = 0.0;
+    std::size_t         mBytes = 0;
+    std::vector<Pool>   mPools;     // by record size in 8 byte units
+
+    void decode(const char* rec, Shape& s) const;
+    void free(Pool& pool, std::uint32_t slot, char* rec);
+};
+
+#endif // INCLUDE_FRONTIER_H
@@ -0,0 +1,151 @@
+// memReport.cpp
+// this file is part of Context Free
+// ---------------------
+// Copyright (C) 2026 John Horigan - john@glyphic.com
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+// John Horigan can be contacted at john@glyphic.com or at
+// John Horigan, 1209 Villa St., Mountain View, CA 94041-1123, USA
+//
+//
+
+
+
+#include "memReport.h"
+#include "cfdg.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+namespace {
+    const char* const ComponentNames[MemReport::NumComponents] = {
+        "unfinished", "finished", "params", "paths", "canvas", "temp files"
+    };
+    const char* const ParamSizeNames[8] = {
+        "0", "1", "2", "3-4", "5-8", "9-16", "17-32", ">32"
+    };
+
+    double
+    megabytes(std::uint64_t bytes)
+    {
+        return static_cast<double>(bytes) / (1024.0 * 1024.0);
+    }
+}
+
+MemReport::MemReport()
+: mStart(clock::now())
+{
+    mTimeline.reserve(MaxPoints);
+}
+
+std::uint64_t
+MemReport::memory(const Sample& s)
+{
+    std::uint64_t total = 0;
+    for (int i = 0; i < TempFiles; ++i)
+        total += s[i];
+    return total;
+}
+
+void
+MemReport::sample(const Sample& bytes)
+{
+    double now = std::chrono::duration<double>(clock::now() - mStart).count();
+    ++mSamples;
+    mLast = {now, bytes};
+    for (int i = 0; i < NumComponents; ++i) {
+        if (bytes[i] > mPeak[i]) {
+            mPeak[i] = bytes[i];
+            mPeakAt[i] = now;
+        }
+    }
+    std::uint64_t total = memory(bytes);
+    if (total > mPeakMemory) {
+        mPeakMemory = total;
+        mPeakMemoryAt = now;
+    }
+
+    if (++mSkipped < mStride)
+        return;
+    mSkipped = 0;
+    if (mTimeline.size() == MaxPoints) {
+        for (std::size_t i = 0; i < MaxPoints / 2; ++i)
+            mTimeline[i] = mTimeline[2 * i + 1];
+        mTimeline.resize(MaxPoints / 2);
+        mStride *= 2;
+    }
+    mTimeline.push_back(mLast);
+}
+
+void
+MemReport::report(std::ostream& out) const
+{
+    char buf[256];
+    std::snprintf(buf, sizeof(buf), "Memory report: %llu samples over %.3f s\n",
+                  static_cast<unsigned long long>(mSamples), mLast.seconds);
+    out << buf;
+    std::snprintf(buf, sizeof(buf), "%-12s %12s %10s %12s\n", "", "peak MB", "at s", "final MB");
+    out << buf;
+    for (int i = 0; i < NumComponents; ++i) {
+        std::snprintf(buf, sizeof(buf), "%-12s %12.2f %10.3f %12.2f\n", ComponentNames[i],
+                      megabytes(mPeak[i]), mPeakAt[i], megabytes(mLast.bytes[i]));
+        out << buf;
+    }
+    std::snprintf(buf, sizeof(buf), "%-12s %12.2f %10.3f %12.2f  (excluding temp files)\n",
+                  "total", megabytes(mPeakMemory), mPeakMemoryAt,
+                  megabytes(memory(mLast.bytes)));
+    out << buf;
+    std::snprintf(buf, sizeof(buf), "Parameter blocks: %llu allocated, %llu live, %u peak\n",
+                  Renderer::ParamAllocs, static_cast<unsigned long long>(Renderer::ParamCount),
+                  Renderer::ParamPeak);
+    out << buf;
+
+    out << "\nParameter block sizes (words):\n";
+    for (std::size_t i = 0; i < Renderer::ParamSizes.size(); ++i) {
+        if (Renderer::ParamSizes[i] == 0)
+            continue;
+        std::snprintf(buf, sizeof(buf), "%12s %12llu  %5.1f%%\n", ParamSizeNames[i],
+                      Renderer::ParamSizes[i],
+                      100.0 * static_cast<double>(Renderer::ParamSizes[i]) /
+                      static_cast<double>(Renderer::ParamAllocs ? Renderer::ParamAllocs : 1));
+        out << buf;
+    }
+
+    if (mTimeline.empty())
+        return;
+    out << "\nTimeline (MB):\n";
+    std::snprintf(buf, sizeof(buf), "%10s", "s");
+    out << buf;
+    for (int i = 0; i < NumComponents; ++i) {
+        std::snprintf(buf, sizeof(buf), " %11s", ComponentNames[i]);
+        out << buf;
+    }
+    out << '\n';
+    std::size_t rows = std::min(mTimeline.size(), TimelineRows);
+    // End with the final sample if the timeline skipped it
+    bool final = mTimeline.back().seconds < mLast.seconds;
+    for (std::size_t r = 0; r < rows + final; ++r) {
+        const Point& p = r < rows ? mTimeline[r * mTimeline.size() / rows] : mLast;
+        std::snprintf(buf, sizeof(buf), "%10.3f", p.seconds);
+        out << buf;
+        for (int i = 0; i < NumComponents; ++i) {
+            std::snprintf(buf, sizeof(buf), " %11.2f", megabytes(p.bytes[i]));
+            out << buf;
+        }
+        out << '\n';
+    }
+}
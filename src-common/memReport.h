@@ -0,0 +1,89 @@
+// memReport.h
+// this file is part of Context Free
+// ---------------------
+// Copyright (C) 2026 John Horigan - john@glyphic.com
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+// John Horigan can be contacted at john@glyphic.com or at
+// John Horigan, 1209 Villa St., Mountain View, CA 94041-1123, USA
+//
+//
+
+
+
+
+#ifndef INCLUDE_MEMREPORT_H
+#define INCLUDE_MEMREPORT_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+// Samples the memory footprint of a render for --mem-report. The renderer
+// only owns a MemReport when one is requested; it takes a sample every few
+// thousand expansions and around spills, merges and output. Peaks are
+// tracked over every sample, the timeline is thinned to a bounded number of
+// points by dropping every other point whenever it fills up.
+
+class MemReport
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    enum Component {
+        Unfinished,     // expansion frontier
+        Finished,       // finished shapes waiting for output
+        Params,         // shape parameter blocks
+        Paths,          // cached and current paths
+        Canvas,         // pixel buffers
+        TempFiles,      // bytes in live temp files (disk, not RAM)
+        NumComponents
+    };
+    using Sample = std::array<std::uint64_t, NumComponents>;
+
+    MemReport();
+
+    void sample(const Sample& bytes);
+
+    // Prints the peak and final size of each component, the parameter block
+    // size histogram and a timeline.
+    void report(std::ostream& out) const;
+
+private:
+    struct Point {
+        double          seconds;
+        Sample          bytes;
+    };
+    static constexpr std::size_t MaxPoints = 1024;
+    static constexpr std::size_t TimelineRows = 40;
+
+    static std::uint64_t memory(const Sample& s);   // all but TempFiles
+
+    clock::time_point   mStart;
+    Sample              mPeak{};
+    std::array<double, NumComponents> mPeakAt{};
+    std::uint64_t       mPeakMemory = 0;
+    double              mPeakMemoryAt = 0.0;
+    Point               mLast{};
+    std::uint64_t       mSamples = 0;
+    std::vector<Point>  mTimeline;
+    std::size_t         mStride = 1;
+    std::size_t         mSkipped = 0;
+};
+
+#endif // INCLUDE_MEMREPORT_H
@@ -0,0 +1,270 @@
+// modBatch.cpp
+// this file is part of Context Free
+// ---------------------
+// Copyright (C) 2026 John Horigan - john@glyphic.com
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+// John Horigan can be contacted at john@glyphic.com or at
+// John Horigan, 1209 Villa St., Mountain View, CA 94041-1123, USA
+//
+//
+
+
+
+#include "modBatch.h"
+#include <cmath>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define MODBATCH_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace {
+    using namespace ModBatch;
+    
+    // Scalar kernels for entries [begin, n), also used for the tail of the
+    // AVX2 kernels
+    void
+    composeScalar(const Block& p, bool broadcast, const Block& m, Block& o,
+                  std::size_t begin, std::size_t n, unsigned parts)
+    {
+        for (std::size_t i = begin; i < n; ++i) {
+            std::size_t j = broadcast ? 0 : i;
+            if (parts & Modification::TransformPart) {
+                // trans_affine::premultiply()
+                double sx  = m.sx[i]  * p.sx[j] + m.shy[i] * p.shx[j];
+                double shx = m.shx[i] * p.sx[j] + m.sy[i]  * p.shx[j];
+                double tx  = m.tx[i]  * p.sx[j] + m.ty[i]  * p.shx[j] + p.tx[j];
+                o.shy[i]   = m.sx[i]  * p.shy[j] + m.shy[i] * p.sy[j];
+                o.sy[i]    = m.shx[i] * p.shy[j] + m.sy[i]  * p.sy[j];
+                o.ty[i]    = m.tx[i]  * p.shy[j] + m.ty[i]  * p.sy[j] + p.ty[j];
+                o.sx[i] = sx; o.shx[i] = shx; o.tx[i] = tx;
+            } else {
+                o.sx[i] = p.sx[j]; o.shy[i] = p.shy[j]; o.shx[i] = p.shx[j];
+                o.sy[i] = p.sy[j]; o.tx[i] = p.tx[j]; o.ty[i] = p.ty[j];
+            }
+            if (parts & Modification::ZPart) {
+                o.tz[i] = m.tz[i] * p.sz[j] + p.tz[j];
+                o.sz[i] = m.sz[i] * p.sz[j];
+            } else {
+                o.sz[i] = p.sz[j]; o.tz[i] = p.tz[j];
+            }
+            if (parts & Modification::TimePart) {
+                o.tbegin[i] = m.tbegin[i] * p.st[j] + p.tbegin[j];
+                o.tend[i]   = m.tend[i]   * p.st[j] + p.tend[j];
+                o.st[i]     = m.st[i]     * p.st[j];
+            } else {
+                o.st[i] = p.st[j]; o.tbegin[i] = p.tbegin[j]; o.tend[i] = p.tend[j];
+            }
+        }
+    }
+    
+    void
+    areaScalar(const Block& b, std::size_t begin, std::size_t n, double* out)
+    {
+        for (std::size_t i = begin; i < n; ++i)
+            out[i] = std::fabs(b.sx[i] * b.sy[i] - b.shy[i] * b.shx[i]);
+    }
+    
+    void
+    finiteScalar(const Block& b, std::size_t begin, std::size_t n, bool* out)
+    {
+        for (std::size_t i = begin; i < n; ++i)
+            out[i] = std::isfinite(b.sx[i]) && std::isfinite(b.shy[i]) &&
+                     std::isfinite(b.shx[i]) && std::isfinite(b.sy[i]) &&
+                     std::isfinite(b.tx[i]) && std::isfinite(b.ty[i]) &&
+                     std::isfinite(b.sz[i]) && std::isfinite(b.tz[i]) &&
+                     std::isfinite(b.st[i]);
+    }
+    
+#ifdef MODBATCH_AVX2
+    // Only AVX2 is enabled for these, not FMA, so the compiler cannot fuse
+    // the multiplies and adds and change the rounding
+#define MODBATCH_TARGET __attribute__((target("avx2")))
+    
+    MODBATCH_TARGET inline __m256d
+    load(const double* a, std::size_t i, bool broadcast)
+    {
+        return broadcast ? _mm256_broadcast_sd(a) : _mm256_load_pd(a + i);
+    }
+    
+    MODBATCH_TARGET void
+    composeAvx2(const Block& p, bool broadcast, const Block& m, Block& o,
+                std::size_t n, unsigned parts)
+    {
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            if (parts & Modification::TransformPart) {
+                __m256d psx = load(p.sx, i, broadcast), pshy = load(p.shy, i, broadcast);
+                __m256d pshx = load(p.shx, i, broadcast), psy = load(p.sy, i, broadcast);
+                __m256d ptx = load(p.tx, i, broadcast), pty = load(p.ty, i, broadcast);
+                __m256d msx = _mm256_load_pd(m.sx + i), mshy = _mm256_load_pd(m.shy + i);
+                __m256d mshx = _mm256_load_pd(m.shx + i), msy = _mm256_load_pd(m.sy + i);
+                __m256d mtx = _mm256_load_pd(m.tx + i), mty = _mm256_load_pd(m.ty + i);
+                _mm256_store_pd(o.sx + i, _mm256_add_pd(_mm256_mul_pd(msx, psx),
+                                                        _mm256_mul_pd(mshy, pshx)));
+                _mm256_store_pd(o.shx + i, _mm256_add_pd(_mm256_mul_pd(mshx, psx),
+                                                         _mm256_mul_pd(msy, pshx)));
+                _mm256_store_pd(o.tx + i, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(mtx, psx),
+                                                                      _mm256_mul_pd(mty, pshx)),
+                                                        ptx));
+                _mm256_store_pd(o.shy + i, _mm256_add_pd(_mm256_mul_pd(msx, pshy),
+                                                         _mm256_mul_pd(mshy, psy)));
+                _mm256_store_pd(o.sy + i, _mm256_add_pd(_mm256_mul_pd(mshx, pshy),
+                                                        _mm256_mul_pd(msy, psy)));
+                _mm256_store_pd(o.ty + i, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(mtx, pshy),
+                                                                      _mm256_mul_pd(mty, psy)),
+                                                        pty));
+            } else {
+                _mm256_store_pd(o.sx + i, load(p.sx, i, broadcast));
+                _mm256_store_pd(o.shy + i, load(p.shy, i, broadcast));
+                _mm256_store_pd(o.shx + i, load(p.shx, i, broadcast));
+                _mm256_store_pd(o.sy + i, load(p.sy, i, broadcast));
+                _mm256_store_pd(o.tx + i, load(p.tx, i, broadcast));
+                _mm256_store_pd(o.ty + i, load(p.ty, i, broadcast));
+            }
+            __m256d psz = load(p.sz, i, broadcast), ptz = load(p.tz, i, broadcast);
+            if (parts & Modification::ZPart) {
+                _mm256_store_pd(o.tz + i, _mm256_add_pd(_mm256_mul_pd(_mm256_load_pd(m.tz + i), psz), ptz));
+                _mm256_store_pd(o.sz + i, _mm256_mul_pd(_mm256_load_pd(m.sz + i), psz));
+            } else {
+                _mm256_store_pd(o.sz + i, psz);
+                _mm256_store_pd(o.tz + i, ptz);
+            }
+            __m256d pst = load(p.st, i, broadcast);
+            __m256d pbegin = load(p.tbegin, i, broadcast), pend = load(p.tend, i, broadcast);
+            if (parts & Modification::TimePart) {
+                _mm256_store_pd(o.tbegin + i, _mm256_add_pd(_mm256_mul_pd(_mm256_load_pd(m.tbegin + i), pst), pbegin));
+                _mm256_store_pd(o.tend + i, _mm256_add_pd(_mm256_mul_pd(_mm256_load_pd(m.tend + i), pst), pend));
+                _mm256_store_pd(o.st + i, _mm256_mul_pd(_mm256_load_pd(m.st + i), pst));
+            } else {
+                _mm256_store_pd(o.st + i, pst);
+                _mm256_store_pd(o.tbegin + i, pbegin);
+                _mm256_store_pd(o.tend + i, pend);
+            }
+        }
+        composeScalar(p, broadcast, m, o, i, n, parts);
+    }
+    
+    MODBATCH_TARGET void
+    areaAvx2(const Block& b, std::size_t n, double* out)
+    {
+        const __m256d sign = _mm256_set1_pd(-0.0);
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256d det = _mm256_sub_pd(_mm256_mul_pd(_mm256_load_pd(b.sx + i), _mm256_load_pd(b.sy + i)),
+                                        _mm256_mul_pd(_mm256_load_pd(b.shy + i), _mm256_load_pd(b.shx + i)));
+            _mm256_storeu_pd(out + i, _mm256_andnot_pd(sign, det));
+        }
+        areaScalar(b, i, n, out);
+    }
+    
+    MODBATCH_TARGET void
+    finiteAvx2(const Block& b, std::size_t n, bool* out)
+    {
+        // x - x is zero exactly when x is finite
+        const __m256d zero = _mm256_setzero_pd();
+        const double* fields[] = { b.sx, b.shy, b.shx, b.sy, b.tx, b.ty, b.sz, b.tz, b.st };
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256d ok = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+            for (const double* f: fields) {
+                __m256d v = _mm256_load_pd(f + i);
+                ok = _mm256_and_pd(ok, _mm256_cmp_pd(_mm256_sub_pd(v, v), zero, _CMP_EQ_OQ));
+            }
+            int mask = _mm256_movemask_pd(ok);
+            for (int k = 0; k < 4; ++k)
+                out[i + k] = (mask >> k) & 1;
+        }
+        finiteScalar(b, i, n, out);
+    }
+    
+    bool Avx2Available = __builtin_cpu_supports("avx2");
+#else
+    bool Avx2Available = false;
+#endif
+    
+    bool UseAvx2 = Avx2Available;
+}
+
+namespace ModBatch {
+    void
+    Block::set(std::size_t i, const Modification& m)
+    {
+        sx[i] = m.m_transform.sx; shy[i] = m.m_transform.shy;
+        shx[i] = m.m_transform.shx; sy[i] = m.m_transform.sy;
+        tx[i] = m.m_transform.tx; ty[i] = m.m_transform.ty;
+        sz[i] = m.m_Z.sz; tz[i] = m.m_Z.tz;
+        st[i] = m.m_time.st; tbegin[i] = m.m_time.tbegin; tend[i] = m.m_time.tend;
+    }
+    
+    void
+    Block::get(std::size_t i, Modification& m) const
+    {
+        getTransform(i, m.m_transform);
+        m.m_Z.sz = sz[i]; m.m_Z.tz = tz[i];
+        m.m_time.st = st[i]; m.m_time.tbegin = tbegin[i]; m.m_time.tend = tend[i];
+    }
+    
+    void
+    compose(const Block& parents, bool broadcast, const Block& mods,
+            Block& out, std::size_t n, unsigned parts)
+    {
+#ifdef MODBATCH_AVX2
+        if (UseAvx2) {
+            composeAvx2(parents, broadcast, mods, out, n, parts);
+            return;
+        }
+#endif
+        composeScalar(parents, broadcast, mods, out, 0, n, parts);
+    }
+    
+    void
+    area(const Block& b, std::size_t n, double* out)
+    {
+#ifdef MODBATCH_AVX2
+        if (UseAvx2) {
+            areaAvx2(b, n, out);
+            return;
+        }
+#endif
+        areaScalar(b, 0, n, out);
+    }
+    
+    void
+    finite(const Block& b, std::size_t n, bool* out)
+    {
+#ifdef MODBATCH_AVX2
+        if (UseAvx2) {
+            finiteAvx2(b, n, out);
+            return;
+        }
+#endif
+        finiteScalar(b, 0, n, out);
+    }
+    
+    bool
+    simd()
+    {
+        return UseAvx2;
+    }
+    
+    void
+    useSimd(bool on)
+    {
+        UseAvx2 = on && Avx2Available;
+    }
+}
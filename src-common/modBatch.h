@@ -0,0 +1,84 @@
+// modBatch.h
+// this file is part of Context Free
+// ---------------------
+// Copyright (C) 2026 John Horigan - john@glyphic.com
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+// John Horigan can be contacted at john@glyphic.com or at
+// John Horigan, 1209 Villa St., Mountain View, CA 94041-1123, USA
+//
+//
+
+
+
+
+#ifndef INCLUDE_MODBATCH_H
+#define INCLUDE_MODBATCH_H
+
+#include "shape.h"
+#include <cstddef>
+
+// Batch kernels for composing the geometry, z and time of many shape
+// adjustments at once. Operands are structure-of-arrays blocks, so each
+// coefficient is a contiguous run of doubles. With AVX2 four shapes are
+// done per instruction, otherwise the loops are scalar. Both use the same
+// operations in the same order as trans_affine, trans_affine_1D and
+// trans_affine_time, and no fused multiply-add, so the results are
+// bit-identical to Modification::compose().
+
+namespace ModBatch {
+    enum : std::size_t { BlockSize = 16 };
+
+    struct Block {
+        alignas(32) double sx[BlockSize];
+        alignas(32) double shy[BlockSize];
+        alignas(32) double shx[BlockSize];
+        alignas(32) double sy[BlockSize];
+        alignas(32) double tx[BlockSize];
+        alignas(32) double ty[BlockSize];
+        alignas(32) double sz[BlockSize];
+        alignas(32) double tz[BlockSize];
+        alignas(32) double st[BlockSize];
+        alignas(32) double tbegin[BlockSize];
+        alignas(32) double tend[BlockSize];
+        
+        // Copies the geometry, z and time to or from entry i
+        void set(std::size_t i, const Modification& m);
+        void get(std::size_t i, Modification& m) const;
+        void getTransform(std::size_t i, agg::trans_affine& tr) const
+        {
+            tr.sx = sx[i]; tr.shy = shy[i]; tr.shx = shx[i];
+            tr.sy = sy[i]; tr.tx = tx[i]; tr.ty = ty[i];
+        }
+    };
+    
+    // out[i] = parents[i] composed with mods[i], for the Modification::Parts
+    // in parts (color is ignored). With a broadcast parent, parents[0] is
+    // used for every entry.
+    void compose(const Block& parents, bool broadcast, const Block& mods,
+                 Block& out, std::size_t n, unsigned parts);
+    // Modification::area() of each entry
+    void area(const Block& b, std::size_t n, double* out);
+    // Modification::isFinite() of each entry, except for color
+    void finite(const Block& b, std::size_t n, bool* out);
+    
+    // Whether the AVX2 kernels are in use, and a switch for checking them
+    // against the scalar ones
+    bool simd();
+    void useSimd(bool on);
+}
+
+#endif // INCLUDE_MODBATCH_H
@@ -0,0 +1,135 @@
+// perfCounters.cpp
+// this file is part of Context Free
+// ---------------------
+// Copyright (C) 2026 John Horigan - john@glyphic.com
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+// John Horigan can be contacted at john@glyphic.com or at
+// John Horigan, 1209 Villa St., Mountain View, CA 94041-1123, USA
+//
+//
+
+
+
+#include "perfCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#endif
+
+#ifdef __linux__
+
+namespace {
+    const std::array<std::pair<std::uint32_t, std::uint64_t>,
+                     AbstractSystem::Stats::NumberOfCounters> Events = {{
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}
+    }};
+
+    int
+    openEvent(std::uint32_t type, std::uint64_t config, int group)
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = group < 0;
+        attr.exclude_kernel = 1;        // allowed at perf_event_paranoid 2
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+    }
+}
+
+PerfCounters::PerfCounters()
+{
+    mFds.fill(-1);
+    mSlot.fill(-1);
+    for (int i = 0; i < Stats::NumberOfCounters; ++i) {
+        int fd = openEvent(Events[i].first, Events[i].second, mLeader);
+        if (fd < 0) {
+            if (mLeader < 0) {
+                // Cycles lead the group, without them there is nothing
+                mError = std::strerror(errno);
+                if (errno == EACCES || errno == EPERM)
+                    mError += " (see /proc/sys/kernel/perf_event_paranoid)";
+                else if (errno == ENOENT || errno == EOPNOTSUPP)
+                    mError += " (no hardware counters, as in most virtual machines)";
+                return;
+            }
+            continue;
+        }
+        if (mLeader < 0)
+            mLeader = fd;
+        mFds[i] = fd;
+        mSlot[i] = mOpened++;
+        mAvailable |= 1u << i;
+    }
+    ioctl(mLeader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(mLeader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+PerfCounters::~PerfCounters()
+{
+    for (int fd: mFds)
+        if (fd >= 0)
+            close(fd);
+}
+
+void
+PerfCounters::read(Counts& counts) const
+{
+    counts.fill(0.0);
+    if (mLeader < 0)
+        return;
+    // nr, time enabled, time running, then one value per counter
+    std::array<std::uint64_t, 3 + Stats::NumberOfCounters> data;
+    if (::read(mLeader, data.data(), sizeof(data)) < static_cast<ssize_t>(3 * sizeof(std::uint64_t)))
+        return;
+    double scale = data[2] ? static_cast<double>(data[1]) / static_cast<double>(data[2]) : 0.0;
+    for (int i = 0; i < Stats::NumberOfCounters; ++i)
+        if (mSlot[i] >= 0 && static_cast<std::uint64_t>(mSlot[i]) < data[0])
+            counts[i] = static_cast<double>(data[3 + mSlot[i]]) * scale;
+}
+
+#else
+
+PerfCounters::PerfCounters()
+: mError("hardware performance counters are only supported on Linux")
+{
+    mFds.fill(-1);
+    mSlot.fill(-1);
+}
+
+PerfCounters::~PerfCounters() = default;
+
+void
+PerfCounters::read(Counts& counts) const
+{
+    counts.fill(0.0);
+}
+
+#endif
@@ -0,0 +1,71 @@
+// perfCounters.h
+// this file is part of Context Free
+// ---------------------
+// Copyright (C) 2026 John Horigan - john@glyphic.com
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+// John Horigan can be contacted at john@glyphic.com or at
+// John Horigan, 1209 Villa St., Mountain View, CA 94041-1123, USA
+//
+//
+
+
+
+
+#ifndef INCLUDE_PERFCOUNTERS_H
+#define INCLUDE_PERFCOUNTERS_H
+
+#include "cfdg.h"
+#include <array>
+#include <string>
+
+// Hardware performance counters of the rendering thread for
+// --perf-counters, using perf_event_open on Linux. The counters are read
+// (one system call) at the start and end of every render phase scope, so
+// they cost nothing unless they are requested. If the kernel or container
+// does not allow perf events, or the platform is not Linux, good() is false
+// and error() says why. Counters the hardware lacks are left out of
+// available() and read as zero.
+
+class PerfCounters
+{
+public:
+    using Stats = AbstractSystem::Stats;
+    using Counts = std::array<double, Stats::NumberOfCounters>;
+
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool good() const { return mLeader >= 0; }
+    const std::string& error() const { return mError; }
+    unsigned available() const { return mAvailable; }   // bit per Stats::Counter
+
+    // Counts since the counters were opened, scaled up if the kernel had to
+    // multiplex them
+    void read(Counts& counts) const;
+
+private:
+    int         mLeader = -1;
+    std::array<int, Stats::NumberOfCounters> mFds;
+    std::array<int, Stats::NumberOfCounters> mSlot;     // position in group read
+    int         mOpened = 0;
+    unsigned    mAvailable = 0;
+    std::string mError;
+};
+
+#endif // INCLUDE_PERFCOUNTERS_H
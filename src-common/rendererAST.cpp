@@ -24,6 +24,7 @@
 
 #include "rendererAST.h"
 #include "builder.h"
+#include <algorithm>
 #include <cassert>
 
 RendererAST::RendererAST(int w, int h)
@@ -55,16 +56,20 @@ RendererAST::init()
 }
 
 bool
-RendererAST::isNatural(RendererAST* r, double n)
+RendererAST::BuilderImpure()
 {
-    if (r && r->mImpure) return true;
-
     std::lock_guard<std::recursive_mutex> lock(Builder::BuilderMutex);
     
-    if (Builder::CurrentBuilder &&
-        Builder::CurrentBuilder->isMyBuilder() &&
-        Builder::CurrentBuilder->impure()) return true;
-    return n >= 0 && n <= (r ? r->mMaxNatural : Builder::MaxNatural) && n == std::floor(n);
+    return Builder::CurrentBuilder &&
+           Builder::CurrentBuilder->isMyBuilder() &&
+           Builder::CurrentBuilder->impure();
+}
+
+bool
+RendererAST::BuilderIsNatural(double n)
+{
+    if (BuilderImpure()) return true;
+    return n >= 0 && n <= Builder::MaxNatural && n == std::floor(n);
 }
 
 void
@@ -102,3 +107,63 @@ RendererAST::unwindStack(std::size_t oldsize, const std::vector<AST::ASTparamete
     mStackSize = oldsize;
     mLogicalStackTop = mCFstack.data() + mStackSize;
 }
+
+param_ptr
+RendererAST::internParams(param_ptr p)
+{
+    if (!mParamIntern || !p)
+        return p;
+    auto found = mParamTable.find(p);
+    if (found != mParamTable.end()) {
+        ++mParamInternHits;
+        return *found;
+    }
+    ++mParamInternMisses;
+    if (mParamInternMisses >= ParamTableMin && mParamInternHits < mParamInternMisses / 4) {
+        mParamIntern = false;
+        mParamTable.clear();
+        return p;
+    }
+    if (mParamTable.size() >= mParamTableLimit) {
+        // Drop the blocks that only the table refers to
+        for (auto it = mParamTable.begin(); it != mParamTable.end(); ) {
+            if (it->get()->mRefCount == 1)
+                it = mParamTable.erase(it);
+            else
+                ++it;
+        }
+        mParamTableLimit = std::max<std::size_t>(ParamTableMin, 2 * mParamTable.size());
+    }
+    mParamTable.insert(p);
+    return p;
+}
+
+void
+RendererAST::clearParamTable()
+{
+    mParamTable.clear();
+    mParamTableLimit = ParamTableMin;
+    mParamIntern = true;
+}
+
+RendererAST::CacheScope::CacheScope(RendererAST* r, std::size_t values, std::size_t stamps)
+: mRenderer(stamps ? r : nullptr)
+{
+    if (!mRenderer)
+        return;
+    std::uint64_t stamp = ++r->mCacheStamp;
+    r->mCacheFrames.push_back({r->mCacheValues.size(), r->mCacheStamps.size(), stamp, stamp});
+    // Stamps left over from earlier frames are all older than this one
+    r->mCacheValues.resize(r->mCacheValues.size() + values);
+    r->mCacheStamps.resize(r->mCacheStamps.size() + stamps);
+}
+
+RendererAST::CacheScope::~CacheScope()
+{
+    if (!mRenderer)
+        return;
+    const CacheFrame& frame = mRenderer->mCacheFrames.back();
+    mRenderer->mCacheValues.resize(frame.mValues);
+    mRenderer->mCacheStamps.resize(frame.mStamps);
+    mRenderer->mCacheFrames.pop_back();
+}
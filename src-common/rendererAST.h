@@ -28,7 +28,11 @@
 #include "cfdg.h"
 #include "CmdInfo.h"
 #include <array>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
 
 class RendererAST : public Renderer {
 public:
@@ -43,11 +47,64 @@ public:
             return (offset < 0) ? (mLogicalStackTop + offset) : (mCFstack.data() + offset);
         }
         
+        // Hidden slots for the expressions that the compiler evaluates once
+        // per rule invocation, loop or loop iteration, see AST::ASTcached. A
+        // rule body or loop that has cached expressions pushes a frame.
+        struct CacheFrame {
+            std::size_t     mValues;
+            std::size_t     mStamps;
+            std::uint64_t   mExecution;     // stamp for the whole rule or loop
+            std::uint64_t   mIteration;     // stamp for the current iteration
+        };
+        std::vector<CacheFrame>     mCacheFrames;
+        std::vector<double>         mCacheValues;
+        std::vector<std::uint64_t>  mCacheStamps;
+        std::uint64_t               mCacheStamp = 0;
+        
+        class CacheScope {
+        public:
+            CacheScope(RendererAST* r, std::size_t values, std::size_t stamps);
+            ~CacheScope();
+            CacheScope(const CacheScope&) = delete;
+            CacheScope& operator=(const CacheScope&) = delete;
+            void nextIteration()
+            {
+                if (mRenderer)
+                    mRenderer->mCacheFrames.back().mIteration = ++mRenderer->mCacheStamp;
+            }
+        private:
+            RendererAST* mRenderer;
+        };
+        
+        // Parameter blocks built while expanding are shared with an earlier
+        // identical block when there is one. The table keeps a reference to
+        // each block and drops the ones that nothing else uses as it grows.
+        // Interning stops if few blocks turn out to be duplicates.
+        enum : std::size_t { ParamTableMin = 4096 };
+        struct ParamHash {
+            std::size_t operator()(const param_ptr& p) const
+            { return StackRule::Hash(p.get()); }
+        };
+        struct ParamIdentical {
+            bool operator()(const param_ptr& a, const param_ptr& b) const
+            { return StackRule::Identical(a.get(), b.get()); }
+        };
+        std::unordered_set<param_ptr, ParamHash, ParamIdentical> mParamTable;
+        std::size_t     mParamTableLimit = ParamTableMin;
+        bool            mParamIntern = true;
+        std::uint64_t   mParamInternHits = 0;
+        std::uint64_t   mParamInternMisses = 0;
+        param_ptr internParams(param_ptr p);
+        void clearParamTable();
+        
         Rand64      mCurrentSeed;
         bool        mRandUsed = false;
     
         double      mMaxNatural = 1000.0;
-        bool        mImpure = false;
+        bool        mImpure = false;    // resolved once per render, see init()
+
+        std::uint64_t mPathCacheHits = 0;
+        std::uint64_t mPathCacheMisses = 0;
 
         double      mCurrentTime = 0.0;
         double      mCurrentFrame = 0.0;
@@ -64,7 +121,15 @@ public:
         AST::InfoCache::iterator mCurrentCommand;
     
         void init();
-        static bool isNatural(RendererAST* r, double n);
+        // Called for every natural parameter of every shape, so the render
+        // time check only reads renderer state
+        static bool isNatural(RendererAST* r, double n)
+        {
+            if (!r)
+                return BuilderIsNatural(n);
+            return r->mImpure || (n >= 0 && n <= r->mMaxNatural && n == std::floor(n));
+        }
+        static bool BuilderImpure();
         static void ColorConflict(RendererAST* r, const yy::location& w);
         virtual void processPathCommand(const Shape& s, const AST::CommandInfo* attr) = 0;
         virtual void processShape(Shape& s) = 0;
@@ -73,6 +138,7 @@ public:
     
     protected:
         RendererAST(int w, int h);
+        static bool BuilderIsNatural(double n);
         virtual void colorConflict(const yy::location& w) = 0;
 };
 
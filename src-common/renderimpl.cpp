@@ -37,6 +37,8 @@
 #include <functional>
 #include <cstddef>
 #include <array>
+#include <chrono>
+#include <sstream>
 
 #include <cmath>
 using std::isfinite;
@@ -47,6 +49,8 @@ using std::isfinite;
 #include "astreplacement.h"
 #include "CmdInfo.h"
 #include "tiledCanvas.h"
+#include "aggCanvas.h"
+#include "costEstimator.h"
 
 using namespace AST;
 
@@ -54,6 +58,80 @@ using namespace AST;
 unsigned int RendererImpl::MoveFinishedAt = 0;     // when this many, move to file
 unsigned int RendererImpl::MoveUnfinishedAt = 0;   // when this many, move to files
 unsigned int RendererImpl::MaxMergeFiles = 0;      // maximum number of files to merge at once
+unsigned int RendererImpl::MergeThreads = 0;       // threads for merging temp files
+
+using Stats = AbstractSystem::Stats;
+
+// Accumulates monotonic clock time for a render phase into m_stats. Scopes
+// nest and the time spent in an inner scope is excluded from the outer one.
+// Scopes with a trace name are also recorded as trace spans. Hardware
+// counters, if on, are accumulated the same way.
+class PhaseScope
+{
+public:
+    PhaseScope(RendererImpl& r, Stats::Phase p, const char* traceName = nullptr)
+    : mRenderer(r), mParent(r.mCurrentPhase), mPhase(p), mTraceName(traceName),
+      mStart(clock::now())
+    {
+        r.mCurrentPhase = this;
+        if (r.mPerf)
+            r.mPerf->read(mStartCounts);
+    }
+    ~PhaseScope()
+    {
+        if (mRenderer.mPerf) {
+            PerfCounters::Counts now;
+            mRenderer.mPerf->read(now);
+            auto& total = mRenderer.m_stats.phaseCounters[mPhase];
+            for (int i = 0; i < Stats::NumberOfCounters; ++i) {
+                double counted = now[i] - mStartCounts[i];
+                total[i] += counted - mNestedCounts[i];
+                if (mParent)
+                    mParent->mNestedCounts[i] += counted;
+            }
+        }
+        clock::time_point end = clock::now();
+        clock::duration elapsed = end - mStart;
+        if (mTraceName && mRenderer.mTrace)
+            mRenderer.mTrace->complete(mTraceName, mStart, end);
+        mRenderer.m_stats.phaseTime[mPhase] +=
+            std::chrono::duration<double>(elapsed - mNested).count();
+        if (mParent)
+            mParent->mNested += elapsed;
+        mRenderer.mCurrentPhase = mParent;
+    }
+    PhaseScope(const PhaseScope&) = delete;
+    PhaseScope& operator=(const PhaseScope&) = delete;
+
+    Stats::Phase phase() const { return mPhase; }
+
+private:
+    using clock = TraceWriter::clock;
+    RendererImpl&       mRenderer;
+    PhaseScope*         mParent;
+    Stats::Phase        mPhase;
+    const char*         mTraceName;
+    clock::time_point   mStart;
+    clock::duration     mNested{0};
+    PerfCounters::Counts mStartCounts;
+    PerfCounters::Counts mNestedCounts{};
+};
+
+// Heap operations are too fine-grained to time unless detailed stats are
+// requested
+template <typename F>
+static void
+heapOp(RendererImpl& r, bool timed, F op)
+{
+    if (timed) {
+        PhaseScope heap(r, Stats::HeapPhase);
+        op();
+    } else {
+        op();
+    }
+}
+
+static const int SampleBatch = 10000;   // expansions per trace span or memory sample
 
 const double SHAPE_BORDER = 1.0; // multiplier of shape size when calculating bounding box
 const double FIXED_BORDER = 8.0; // fixed extra border, in pixels
@@ -76,10 +154,12 @@ RendererImpl::RendererImpl( const cfdg_ptr& cfdg,
             MoveFinishedAt = MoveUnfinishedAt = static_cast<unsigned int>(mem / (sizeof(FinishedShape) * 4));
         }
         MaxMergeFiles      =      200; // maximum number of files to merge at once
+        MergeThreads       = std::thread::hardware_concurrency();
 #else
         MoveFinishedAt     =    1000; // when this many, move to file
         MoveUnfinishedAt   =     200; // when this many, move to files
         MaxMergeFiles      =       4; // maximum number of files to merge at once
+        MergeThreads       =       4; // threads for merging temp files
 #endif
     }
     
@@ -117,6 +197,7 @@ RendererImpl::init()
         if (const ASTdefine* def = dynamic_cast<const ASTdefine*> (rep.get()))
             def->traverse(dummy, false, this);
     }
+    clearParamTable();
     
     mFinishedFileCount = 0;
     mUnfinishedFileCount = 0;
@@ -142,6 +223,10 @@ RendererImpl::init()
     if (mShapeBorder <= 0.0)
         mShapeBorder = 1.0;
     
+    // A builder running on this thread can make the design impure too.
+    // Resolving it here keeps the natural number checks lock free.
+    mImpure = m_cfdg->m_impure || BuilderImpure();
+    
     if (m_cfdg->hasParameter(CFG::MaxNatural, mMaxNatural, this) &&
         (mMaxNatural < 1.0 || (mMaxNatural - 1.0) == mMaxNatural))
     {
@@ -211,13 +296,16 @@ RendererImpl::cleanup()
     m_unfinishedFiles.clear();
 
     // Delete all shapes and parameters (except those in the AST)
-    mUnfinishedShapes.clear();
+    clearUnfinished();
     mFinishedShapes.clear();
+    mInstanceLists.clear();
+    mFinishedInstances = 0;
     
     // Delete the global definitions
     unwindStack(0, m_cfdg->mCFDGcontents.mParameters);
     
     mCurrentPath.reset();
+    clearParamTable();
     m_cfdg->resetCachedPaths();
 }
 
@@ -227,6 +315,102 @@ RendererImpl::setMaxShapes(int n)
     m_maxShapes = n ? n : 400000000;
 }
 
+void
+RendererImpl::setFrontierTolerance(double t)
+{
+    mFrontier.setTolerance(t > 0.0 ? t : 0.0);
+}
+
+void
+RendererImpl::clearUnfinished()
+{
+    for (auto&& e: mUnfinishedShapes)
+        mFrontier.erase(e);
+    mUnfinishedShapes.clear();
+    mFrontier.clear();
+}
+
+void
+RendererImpl::setDetailedStats(bool on)
+{
+    m_stats.detailed = on;
+}
+
+bool
+RendererImpl::startTrace(const std::string& path)
+{
+    mTrace = std::make_unique<TraceWriter>(path);
+    if (!mTrace->good())
+        mTrace.reset();
+    return mTrace != nullptr;
+}
+
+bool
+RendererImpl::startPerfCounters(std::string& error)
+{
+    mPerf = std::make_unique<PerfCounters>();
+    if (!mPerf->good()) {
+        error = mPerf->error();
+        mPerf.reset();
+        return false;
+    }
+    m_stats.counterMask = mPerf->available();
+    return true;
+}
+
+void
+RendererImpl::traceCounters()
+{
+    mTrace->counter("frontier", static_cast<double>(mUnfinishedShapes.size()));
+    mTrace->counter("finished", static_cast<double>(m_stats.shapeCount));
+}
+
+void
+RendererImpl::sampleMemory(bool on)
+{
+    if (!on)
+        mMemReport.reset();
+    else if (!mMemReport)
+        mMemReport = std::make_unique<MemReport>();
+}
+
+void
+RendererImpl::memoryReport(std::ostream& out)
+{
+    if (mMemReport)
+        mMemReport->report(out);
+}
+
+static std::uint64_t
+pathBytes(const ASTcompiledPath* path)
+{
+    if (!path)
+        return 0;
+    return sizeof(ASTcompiledPath) +
+           path->mPath.total_vertices() * (2 * sizeof(double) + 1) +
+           path->mCommandInfo.size() * sizeof(CommandInfo);
+}
+
+void
+RendererImpl::memorySample()
+{
+    MemReport::Sample bytes{};
+    bytes[MemReport::Unfinished] = unfinishedBytes();
+    bytes[MemReport::Finished] = mFinishedShapes.size() * sizeof(FinishedShape) +
+                                 mInstanceLists.size() * sizeof(FinishedShape::InstanceList) +
+                                 mFinishedInstances * sizeof(FinishedShape::Instance);
+    bytes[MemReport::Params] = Renderer::ParamBytes;
+    bytes[MemReport::Paths] = pathBytes(mCurrentPath.get());
+    for (const ASTrule* rule: m_cfdg->mRules)
+        bytes[MemReport::Paths] += pathBytes(rule->mCachedPath.get());
+    bytes[MemReport::Canvas] = m_canvas ? m_canvas->bufferBytes() : 0;
+    for (auto* files: {&m_unfinishedFiles, &m_finishedFiles})
+        for (const TempFile& file: *files)
+            if (file.written())
+                bytes[MemReport::TempFiles] += file.bytes();
+    mMemReport->sample(bytes);
+}
+
 void
 RendererImpl::resetBounds()
 {
@@ -273,8 +457,13 @@ RendererImpl::run(Canvas * canvas, bool partialDraw)
     int reportAt = 250;
 
     {
+        PhaseScope expanding(*this, Stats::ExpandPhase, "run");
+        auto batchStart = TraceWriter::clock::now();
+        int batchCount = 0;
+        
         Shape initShape = m_cfdg->getInitialShape(this);
         initShape.mWorldState.mRand64Seed = mCurrentSeed;
+        mFrontier.setReference(initShape.mWorldState);
         if (!m_timed)
             mTimeBounds = initShape.mWorldState.m_time;
         
@@ -288,45 +477,88 @@ RendererImpl::run(Canvas * canvas, bool partialDraw)
             requestStop = true;
             system()->catastrophicError(e.what());
         }
-    }
     
-    for (;;) {
-        fileIfNecessary();
+        for (;;) {
+            if ((mTrace || mMemReport) && ++batchCount >= SampleBatch) {
+                auto now = TraceWriter::clock::now();
+                if (mTrace) {
+                    mTrace->complete("expand batch", batchStart, now, batchCount);
+                    traceCounters();
+                }
+                if (mMemReport)
+                    memorySample();
+                batchStart = now;
+                batchCount = 0;
+            }
+            
+            fileIfNecessary();
         
-        if (requestStop) break;
-        if (requestFinishUp) break;
+            if (requestStop) break;
+            if (requestFinishUp) break;
         
-        if (mUnfinishedShapes.empty()) break;
-        if (std::max(m_stats.shapeCount, m_stats.toDoCount) >= m_maxShapes)
-            break;
-
-        // Get the largest unfinished shape
-        Shape s(std::move(mUnfinishedShapes.front()));
-        std::pop_heap(mUnfinishedShapes.begin(), mUnfinishedShapes.end());
-        mUnfinishedShapes.pop_back();
-        m_stats.toDoCount--;
+            if (mUnfinishedShapes.empty() && !mHolding) break;
+            if (std::max(m_stats.shapeCount, m_stats.toDoCount) >= m_maxShapes)
+                break;
+
+            // Get the largest unfinished shape
+            Shape s(mHolding ? std::move(mHeldShape) : mFrontier.take(mUnfinishedShapes.front()));
+            if (mHolding) {
+                mHolding = false;
+            } else {
+                heapOp(*this, m_stats.detailed, [this]() {
+                    std::pop_heap(mUnfinishedShapes.begin(), mUnfinishedShapes.end());
+                });
+                mUnfinishedShapes.pop_back();
+            }
+            m_stats.toDoCount--;
         
-        try {
-            const ASTrule* rule = m_cfdg->findRule(s.mShapeType, s.mWorldState.mRand64Seed.getDouble());
-            m_drawingMode = false;      // shouldn't matter
-            rule->traverseRule(s, this);
-        } catch (CfdgError& e) {
-            requestStop = true;
-            system()->error();
-            system()->syntaxError(e);
-            break;
-        } catch (std::exception& e) {
-            requestStop = true;
-            system()->catastrophicError(e.what());
-            break;
+            try {
+                const ASTrule* rule = m_cfdg->findRule(s.mShapeType, s.mWorldState.mRand64Seed.getDouble());
+                m_drawingMode = false;      // shouldn't matter
+                mCanHold = mUnfinishedShapes.size() <= 1;
+                if (mProfiler) {
+                    mProfiler->enter(rule);
+                    rule->traverseRule(s, this);
+                    mProfiler->leave();
+                } else {
+                    rule->traverseRule(s, this);
+                }
+                mCanHold = false;
+                // The held child is only expanded next without the frontier
+                // if the heap would pop it next and be left unchanged, which
+                // needs a heap of at most one strictly smaller shape
+                if (mHolding && !mUnfinishedShapes.empty() &&
+                    !(mUnfinishedShapes.size() == 1 &&
+                      mUnfinishedShapes.front().area() < mHeldShape.area()))
+                    releaseHeldShape();
+            } catch (CfdgError& e) {
+                requestStop = true;
+                system()->error();
+                system()->syntaxError(e);
+                break;
+            } catch (std::exception& e) {
+                requestStop = true;
+                system()->catastrophicError(e.what());
+                break;
+            }
+        
+            if (requestUpdate || (m_stats.shapeCount > reportAt)) {
+                if (partialDraw)
+                  outputPartial();
+                outputStats();
+                reportAt = 2 * m_stats.shapeCount;
+            }
         }
         
-        if (requestUpdate || (m_stats.shapeCount > reportAt)) {
-            if (partialDraw)
-              outputPartial();
-            outputStats();
-            reportAt = 2 * m_stats.shapeCount;
+        mCanHold = false;
+        releaseHeldShape();
+        
+        if (mTrace) {
+            mTrace->complete("expand batch", batchStart, TraceWriter::clock::now(), batchCount);
+            traceCounters();
         }
+        if (mMemReport)
+            memorySample();
     }
     
     if (!m_cfdg->usesTime && !m_timed) 
@@ -355,6 +587,218 @@ RendererImpl::draw(Canvas* canvas)
     outputStats();
 }
 
+namespace {
+    // Pixel buffer for timing rasterization in estimate()
+    class EstimateCanvas final : public aggCanvas {
+    public:
+        EstimateCanvas(PixelFormat format, int width, int height)
+        : aggCanvas(format),
+          mData(static_cast<std::size_t>(width) * height * BytesPerPixel.at(format))
+        {
+            attach(mData.data(), width, height, width * BytesPerPixel.at(format));
+        }
+    private:
+        std::vector<unsigned char> mData;
+    };
+
+    const std::size_t RasterSamples = 20000;    // shapes drawn to time rasterization
+}
+
+// Expands the design for about sampleSeconds and extrapolates the cost of
+// the full render. The sample is the start of a real render, so the
+// renderer is not reset and cannot be used to render afterwards.
+Renderer::Estimate
+RendererImpl::estimate(double sampleSeconds)
+{
+    using clock = std::chrono::steady_clock;
+    Estimate est;
+    CostEstimator sample;
+    outputPrep(nullptr);
+
+    auto start = clock::now();
+    auto elapsed = [start]() {
+        return std::chrono::duration<double>(clock::now() - start).count();
+    };
+    // Stay well clear of spilling to temp files
+    std::size_t limit = std::min(MoveFinishedAt, MoveUnfinishedAt) / 2;
+    double expansions = 0.0;
+    double peakFrontier = 0.0;
+    bool sampled = false;       // stopped before the design was finished
+
+    Shape initShape = m_cfdg->getInitialShape(this);
+    initShape.mWorldState.mRand64Seed = mCurrentSeed;
+    mFrontier.setReference(initShape.mWorldState);
+    if (!m_timed)
+        mTimeBounds = initShape.mWorldState.m_time;
+    try {
+        processShape(initShape);
+        while (!requestStop && !mUnfinishedShapes.empty()) {
+            if (std::max(m_stats.shapeCount, m_stats.toDoCount) >= m_maxShapes)
+                break;
+            if (mFinishedShapes.size() >= limit || mUnfinishedShapes.size() >= limit ||
+                ((static_cast<long long>(expansions) & 255) == 0 && elapsed() > sampleSeconds))
+            {
+                sampled = true;
+                break;
+            }
+            double frontier = static_cast<double>(mUnfinishedShapes.size());
+            peakFrontier = std::max(peakFrontier, frontier);
+            double area = mUnfinishedShapes.front().area();
+            if (sample.wants(area))
+                sample.checkpoint(area, {expansions, static_cast<double>(m_stats.shapeCount),
+                                         frontier}, elapsed());
+
+            Shape s(mFrontier.take(mUnfinishedShapes.front()));
+            std::pop_heap(mUnfinishedShapes.begin(), mUnfinishedShapes.end());
+            mUnfinishedShapes.pop_back();
+            m_stats.toDoCount--;
+
+            const ASTrule* rule = m_cfdg->findRule(s.mShapeType, s.mWorldState.mRand64Seed.getDouble());
+            m_drawingMode = false;
+            rule->traverseRule(s, this);
+            expansions += 1.0;
+        }
+    } catch (CfdgError& e) {
+        requestStop = true;
+        system()->error();
+        system()->syntaxError(e);
+    } catch (std::exception& e) {
+        requestStop = true;
+        system()->catastrophicError(e.what());
+    }
+    est.sampleSeconds = elapsed();
+    est.sampleExpansions = expansions;
+    est.minimumSize = std::sqrt(m_minArea);
+
+    double finished = static_cast<double>(m_stats.shapeCount);
+    double frontier = static_cast<double>(mUnfinishedShapes.size());
+    double frontierParams = frontier > 0.0 ? static_cast<double>(Renderer::ParamBytes) / frontier : 0.0;
+    double expansionSeconds = expansions > 0.0 ? est.sampleSeconds / expansions : 0.0;
+    if (!sampled || sample.empty()) {
+        est.complete = !sampled;
+        est.sizeReached = est.minimumSize;
+        est.shapes = {finished, finished, finished};
+        est.expansions = {expansions, expansions, expansions};
+        est.frontier = {peakFrontier, peakFrontier, peakFrontier};
+    } else {
+        double minArea = mScaleArea > 0.0 ? m_minArea / mScaleArea : 0.0;
+        est.sizeReached = std::sqrt(sample.lastArea() * mScaleArea);
+        est.shapes = sample.extrapolate(CostEstimator::Finished, minArea, finished);
+        est.expansions = sample.extrapolate(CostEstimator::Expansions, minArea,
+                                            expansions + frontier);
+        est.frontier = sample.extrapolate(CostEstimator::Frontier, minArea, peakFrontier);
+        if (sample.expansionSeconds() > 0.0)
+            expansionSeconds = sample.expansionSeconds();
+
+        // The render stops at CF::MaxShapes
+        double maxShapes = static_cast<double>(m_maxShapes);
+        for (auto bound: {&Estimate::Range::value, &Estimate::Range::low, &Estimate::Range::high}) {
+            if (est.shapes.*bound > maxShapes) {
+                est.expansions.*bound *= maxShapes / est.shapes.*bound;
+                est.shapes.*bound = maxShapes;
+            }
+            est.frontier.*bound = std::min(est.frontier.*bound, maxShapes);
+        }
+        for (auto range: {&est.shapes, &est.expansions, &est.frontier}) {
+            range->low = std::min(range->low, range->value);
+            range->high = std::max(range->high, range->value);
+        }
+    }
+
+    // Time drawing the smaller half of the sampled shapes, they are the most
+    // like the bulk of the shapes in the full render
+    double drawSeconds = 0.0;
+    aggCanvas::PixelFormat format = aggCanvas::SuggestPixelFormat(m_cfdg.get());
+    std::size_t n = mFinishedShapes.size();
+    if (n && mBounds.valid() && !requestStop) {
+        EstimateCanvas canvas(format, m_width, m_height);
+        int width = m_width, height = m_height;
+        m_canvas = &canvas;
+        rescaleOutput(width, height, true);
+        mFinal = true;
+        m_drawingMode = true;
+        canvas.start(true, m_cfdg->getBackgroundColor(), width, height);
+        std::size_t step = std::max<std::size_t>(1, (n - n / 2) / RasterSamples);
+        std::size_t drawn = 0;
+        auto drawStart = clock::now();
+        try {
+            for (std::size_t i = n / 2; i < n; i += step)
+                forEachInstance(mFinishedShapes[i], [&](const FinishedShape& s) {
+                    drawShape(s);
+                    ++drawn;
+                });
+        }
+        catch (Stopped&) { }
+        catch (std::exception& e) {
+            system()->catastrophicError(e.what());
+        }
+        if (drawn)
+            drawSeconds = std::chrono::duration<double>(clock::now() - drawStart).count() / drawn;
+        m_canvas = nullptr;
+    }
+
+    double sortSeconds = 0.0;   // per n log n
+    if (n > 1) {
+        auto sortStart = clock::now();
+        std::sort(mFinishedShapes.begin(), mFinishedShapes.end());
+        sortSeconds = std::chrono::duration<double>(clock::now() - sortStart).count() /
+                      (static_cast<double>(n) * std::log2(static_cast<double>(n)));
+    }
+
+    // Bytes per shape in memory and in temp files
+    std::ostringstream written;
+    if (n)
+        mFinishedShapes.front().write(written);
+    double finishedBytes = n ? static_cast<double>(written.str().size()) : sizeof(FinishedShape);
+    written.str(std::string());
+    if (!mUnfinishedShapes.empty())
+        mFrontier.peek(mUnfinishedShapes.front()).write(written);
+    double shapeBytes = mUnfinishedShapes.empty() ? sizeof(Shape) :
+                        static_cast<double>(written.str().size());
+    // Pending shapes are encoded, see FrontierStore and fileIfNecessary()
+    double encodedBytes = mUnfinishedShapes.empty() ? sizeof(Shape) :
+                          static_cast<double>(unfinishedBytes()) / mUnfinishedShapes.size();
+    double frontierBytes = encodedBytes + frontierParams;
+    double canvasBytes = static_cast<double>(m_width) * m_height *
+                         aggCanvas::BytesPerPixel.at(format);
+    double moveFinished = MoveFinishedAt, moveUnfinished = MoveUnfinishedAt;
+    if (mFrontier.tolerance() > 0.0)
+        moveUnfinished *= sizeof(Shape) / encodedBytes;
+
+    // The frontier peaks while about half the shapes are finished, then it
+    // drains into finished shapes
+    auto memory = [&](double shapes, double pending) {
+        double finishedMem = std::min(shapes, moveFinished) * sizeof(FinishedShape);
+        return std::max(std::min(pending, moveUnfinished) * frontierBytes + finishedMem * 0.5,
+                        finishedMem) + canvasBytes;
+    };
+    auto spill = [&](double shapes, double pending) {
+        double bytes = 0.0;
+        if (shapes > moveFinished) {
+            bytes += shapes * finishedBytes;
+            // Merge passes rewrite MaxMergeFiles files at a time
+            double files = std::ceil(shapes / moveFinished);
+            if (files > MaxMergeFiles)
+                bytes += std::ceil((files - MaxMergeFiles) / (MaxMergeFiles - 1)) *
+                         MaxMergeFiles * moveFinished * finishedBytes;
+        }
+        // Each expansion spill writes two thirds of the frontier
+        if (pending > moveUnfinished)
+            bytes += (pending - moveUnfinished / 3.0) * shapeBytes;
+        return bytes;
+    };
+    auto seconds = [&](double shapes, double expanded) {
+        return expanded * expansionSeconds + shapes * drawSeconds +
+               (shapes > 1.0 ? shapes * std::log2(shapes) * sortSeconds : 0.0);
+    };
+    for (auto bound: {&Estimate::Range::value, &Estimate::Range::low, &Estimate::Range::high}) {
+        est.memoryBytes.*bound = memory(est.shapes.*bound, est.frontier.*bound);
+        est.spillBytes.*bound = spill(est.shapes.*bound, est.frontier.*bound);
+        est.seconds.*bound = seconds(est.shapes.*bound, est.expansions.*bound);
+    }
+    return est;
+}
+
 class OutputBounds
 {
 public:
@@ -505,6 +949,7 @@ RendererImpl::animate(Canvas* canvas, int frames, int frame, bool zoom)
     OutputBounds outputBounds(frames, mTimeBounds, curr_width, curr_height, *this);
     if (!ftime) {
         system()->message("Computing zoom");
+        TraceSpan zoomSpan(mTrace.get(), "compute zoom", frames);
 
         try {
             forEachShape(true, [&](const FinishedShape& s) {
@@ -532,6 +977,7 @@ RendererImpl::animate(Canvas* canvas, int frames, int frame, bool zoom)
     for (int frameCount = 1; frameCount <= frames; ++frameCount)
     {
         if (frame && frameCount != frame) continue;
+        TraceSpan frameSpan(mTrace.get(), "frame", frameCount);
         system()->message("Generating frame %d of %d", frameCount, frames);
         
         if (zoom) mBounds = outputBounds.frameBounds(frameCount - 1);
@@ -577,6 +1023,22 @@ RendererImpl::animate(Canvas* canvas, int frames, int frame, bool zoom)
         system()->message("Animation of %d frames complete", frames);
 }
 
+void
+RendererImpl::profileRules(bool on)
+{
+    if (!on)
+        mProfiler.reset();
+    else if (!mProfiler)
+        mProfiler = std::make_unique<RuleProfiler>();
+}
+
+void
+RendererImpl::ruleProfile(std::ostream& table, std::ostream* folded)
+{
+    if (mProfiler)
+        mProfiler->report(table, folded, *m_cfdg);
+}
+
 void
 RendererImpl::processShape(Shape& s)
 {
@@ -598,8 +1060,18 @@ RendererImpl::processShape(Shape& s)
         // only add it if it's big enough (or if there are no finished shapes yet)
         if (!mBounds.valid() || (area * mScaleArea >= m_minArea)) {
             m_stats.toDoCount++;
-            mUnfinishedShapes.push_back(std::move(s));
-            std::push_heap(mUnfinishedShapes.begin(), mUnfinishedShapes.end());
+            if (mCanHold && !mHolding) {
+                mHeldShape = std::move(s);
+                mHolding = true;
+                return;
+            }
+            // A sibling arrived, so the held child goes in first
+            mCanHold = false;
+            releaseHeldShape();
+            mUnfinishedShapes.push_back(mFrontier.put(std::move(s)));
+            heapOp(*this, m_stats.detailed, [this]() {
+                std::push_heap(mUnfinishedShapes.begin(), mUnfinishedShapes.end());
+            });
         }
     } else if (m_cfdg->getShapeType(s.mShapeType) == CFDGImpl::pathType) {
         const ASTrule* rule = m_cfdg->findRule(s.mShapeType, 0.0);
@@ -614,22 +1086,77 @@ RendererImpl::processShape(Shape& s)
     }
 }
 
+void
+RendererImpl::releaseHeldShape()
+{
+    // Pushes the held child onto the frontier where processShape() would
+    // have put it
+    if (!mHolding)
+        return;
+    mHolding = false;
+    mUnfinishedShapes.push_back(mFrontier.put(std::move(mHeldShape)));
+    heapOp(*this, m_stats.detailed, [this]() {
+        std::push_heap(mUnfinishedShapes.begin(), mUnfinishedShapes.end());
+    });
+}
+
 void
 RendererImpl::processPrimShape(Shape& s, const ASTrule* path)
 {
     if (mSymmetryOps.empty() || s.mShapeType == primShape::fillType) {
         processPrimShapeSiblings(std::move(s), path);
     } else {
-        for (auto&& xform: mSymmetryOps) {
+        // Keep one shape for the whole symmetry group along with what
+        // differs between the copies. forEachInstance() rebuilds the copies
+        // when the shapes are drawn.
+        FinishedShape::InstanceList instances;
+        FinishedShape fs;
+        Bounds orbit;
+        for (std::size_t i = 0; i < mSymmetryOps.size(); ++i) {
             Shape sym(s);
-            sym.mWorldState.m_transform.multiply(xform);
-            processPrimShapeSiblings(std::move(sym), path);
+            sym.mWorldState.m_transform.multiply(mSymmetryOps[i]);
+            if (!finishShape(std::move(sym), path, fs)) {
+                if (requestStop)
+                    return;
+                continue;
+            }
+            instances.push_back({static_cast<unsigned>(i),
+                                 fs.mWorldState.m_ColorAssignment,
+                                 fs.mWorldState.m_Z.sz,
+                                 fs.mWorldState.m_time.tbegin,
+                                 fs.mBounds});
+            orbit += fs.mBounds;
+        }
+        if (instances.size() == 1) {
+            mFinishedShapes.push_back(std::move(fs));
+        } else if (!instances.empty()) {
+            const FinishedShape::Instance& first = instances.front();
+            FinishedShape group(std::move(s), static_cast<int>(first.mOrder), orbit);
+            group.mWorldState.m_Z.sz = first.mArea;
+            if (!m_cfdg->usesTime) {
+                group.mWorldState.m_time.tbegin = first.mTimeBegin;
+                group.mWorldState.m_time.tend = Renderer::Infinity;
+            }
+            mFinishedInstances += instances.size();
+            mInstanceLists.push_back(std::move(instances));
+            group.mInstanceIndex = static_cast<std::uint32_t>(mInstanceLists.size());
+            mFinishedShapes.push_back(std::move(group));
         }
     }
 }
 
 void
 RendererImpl::processPrimShapeSiblings(Shape&& s, const ASTrule* path)
+{
+    FinishedShape fs;
+    if (finishShape(std::move(s), path, fs))
+        mFinishedShapes.push_back(std::move(fs));
+}
+
+// Computes the bounds, area and drawing order of a primitive shape. Returns
+// false if the shape should not be kept.
+bool
+RendererImpl::finishShape(Shape&& s, const ASTrule* path, FinishedShape& fs)
 {
     if (mScale == 0.0) {
         // If we don't know the approximate scale yet then just
@@ -642,7 +1169,10 @@ RendererImpl::processPrimShapeSiblings(Shape&& s, const ASTrule* path)
         m_drawingMode = false;
         if (path) {
             mOpsOnly = false;
+            bool profiled = mProfiler && mProfiler->enter(path);
             path->traversePath(s, this);
+            if (profiled)
+                mProfiler->leave();
         } else {
             CommandInfo* attr = nullptr;
             if (s.mShapeType < 3) attr = &(shapeMap[s.mShapeType]);
@@ -651,7 +1181,7 @@ RendererImpl::processPrimShapeSiblings(Shape&& s, const ASTrule* path)
         // Drop off-canvas shapes if CF::Size is specified, or any shape where
         // something weird happened while determining its bounds
         if (!mPathBounds.valid() || (m_sized && !mPathBounds.overlaps(mBounds)))
-            return;
+            return false;
         mTotalArea += mCurrentArea;
         if (!m_tiled && !m_sized) {
             mBounds.merge(mPathBounds.dilate(mShapeBorder));
@@ -667,7 +1197,7 @@ RendererImpl::processPrimShapeSiblings(Shape&& s, const ASTrule* path)
         mCurrentArea = 1.0;
     }
     m_stats.shapeCount++;
-    FinishedShape fs(std::move(s), m_stats.shapeCount, mPathBounds);
+    fs = FinishedShape(std::move(s), m_stats.shapeCount, mPathBounds);
     fs.mWorldState.m_Z.sz = mCurrentArea;
     if (!m_cfdg->usesTime) {
         fs.mWorldState.m_time.tbegin = mTotalArea;
@@ -697,12 +1227,15 @@ RendererImpl::processPrimShapeSiblings(Shape&& s, const ASTrule* path)
         requestStop = true;
         system()->error();
         system()->message("A shape has undefined or infinite state: %s", m_cfdg->decodeShapeName(fs.mShapeType).c_str());
-        return;
+        return false;
     }
     // Drop shapes outside the current frame if we are animating and rerunning
     // the cfdg file for every frame.
-    if (!m_cfdg->usesFrameTime || fs.mWorldState.m_time.overlaps(mFrameTimeBounds))
-        mFinishedShapes.push_back(fs);
+    if (m_cfdg->usesFrameTime && !fs.mWorldState.m_time.overlaps(mFrameTimeBounds))
+        return false;
+    if (mProfiler)
+        mProfiler->finishedShape();
+    return true;
 }
 
 void
@@ -732,18 +1265,27 @@ RendererImpl::processSubpath(const Shape& s, bool tr, int expectedType)
 void
 RendererImpl::fileIfNecessary()
 {
-    if (mFinishedShapes.size() > MoveFinishedAt)
+    // Symmetry copies are counted by how much memory they take
+    std::size_t finishedLoad = mFinishedShapes.size() + mFinishedInstances *
+                               sizeof(FinishedShape::Instance) / sizeof(FinishedShape);
+    if (finishedLoad > MoveFinishedAt)
         moveFinishedToFile();
 
-    if (mUnfinishedShapes.size() > MoveUnfinishedAt)
+    // A lossy frontier spills by its encoded size, so it holds more
+    // shapes. An exact one spills by count, which keeps the expansion
+    // order, and so the output, the same as with whole shapes.
+    if (mFrontier.tolerance() > 0.0 ? unfinishedBytes() > MoveUnfinishedAt * sizeof(Shape)
+                                    : mUnfinishedShapes.size() > MoveUnfinishedAt)
         moveUnfinishedToTwoFiles();
-    else if (mUnfinishedShapes.empty())
+    else if (mUnfinishedShapes.empty() && !mHolding)
         getUnfinishedFromFile();
 }
 
 void
 RendererImpl::moveUnfinishedToTwoFiles()
 {
+    PhaseScope spilling(*this, Stats::SpillWritePhase, "moveUnfinishedToTwoFiles");
+    
     m_unfinishedFiles.emplace_back(system(), AbstractSystem::ExpansionTemp,
                                    ++mUnfinishedFileCount);
     auto f1 = m_unfinishedFiles.back().forWrite();
@@ -774,7 +1316,7 @@ RendererImpl::moveUnfinishedToTwoFiles()
         outStats.showProgress = true;
         // Split the bottom 2/3 of the heap between the two files
         while (usi != use) {
-            usi->write(*((m_unfinishedInFilesCount & 1) ? f1 : f2));
+            mFrontier.peek(*usi).write(*((m_unfinishedInFilesCount & 1) ? f1 : f2));
             ++usi;
             ++m_unfinishedInFilesCount;
             ++outStats.outputDone;
@@ -790,11 +1332,25 @@ RendererImpl::moveUnfinishedToTwoFiles()
         requestStop = true;
         return;
     }
+    
+    m_stats.spillFiles += 2;
+    auto file = m_unfinishedFiles.end() - 2;
+    for (auto&& f: {f1.get(), f2.get()}) {
+        auto pos = f->tellp();
+        if (pos > 0) {
+            m_stats.bytesSpilled += static_cast<unsigned long long>(pos);
+            file->setBytes(static_cast<unsigned long long>(pos));
+        }
+        ++file;
+    }
 
     // Remove the written shapes, heap property remains intact
-    static const Shape neverActuallyUsed;
-    mUnfinishedShapes.resize(count, neverActuallyUsed);
+    for (usi = mUnfinishedShapes.begin() + count; usi != use; ++usi)
+        mFrontier.erase(*usi);
+    mUnfinishedShapes.resize(count, FrontierStore::Entry());
     assert(std::is_heap(mUnfinishedShapes.begin(), mUnfinishedShapes.end()));
+    if (mMemReport)
+        memorySample();
 }
 
 void
@@ -802,6 +1358,8 @@ RendererImpl::getUnfinishedFromFile()
 {
     if (m_unfinishedFiles.empty()) return;
     
+    PhaseScope reading(*this, Stats::SpillReadPhase, "getUnfinishedFromFile");
+    
     TempFile t(std::move(m_unfinishedFiles.front()));
     m_unfinishedFiles.pop_front();
     
@@ -815,9 +1373,10 @@ RendererImpl::getUnfinishedFromFile()
         outStats.showProgress = true;
         std::istream_iterator<Shape> it(*f);
         std::istream_iterator<Shape> eit;
-        std::back_insert_iterator< UnfinishedContainer > sendto(mUnfinishedShapes);
         while (it != eit) {
-            *sendto = *it;
+            Shape s(*it);
+            s.mParameters = internParams(std::move(s.mParameters));
+            mUnfinishedShapes.push_back(mFrontier.put(std::move(s)));
             ++it;
             ++outStats.outputDone;
             if (requestUpdate) {
@@ -834,6 +1393,8 @@ RendererImpl::getUnfinishedFromFile()
     }
     system()->message("Resorting expansions");
     fixupHeap();
+    if (mMemReport)
+        memorySample();
 }
 
 void
@@ -845,6 +1406,8 @@ RendererImpl::fixupHeap()
     auto n = mUnfinishedShapes.size();
     if (n < 2)
         return;
+    
+    PhaseScope heap(*this, Stats::HeapPhase, "fixupHeap");
 
     AbstractSystem::Stats outStats = m_stats;
     outStats.mSystem = system();
@@ -871,6 +1434,8 @@ RendererImpl::fixupHeap()
 void
 RendererImpl::moveFinishedToFile()
 {
+    PhaseScope spilling(*this, Stats::SpillWritePhase, "moveFinishedToFile");
+    
     m_finishedFiles.emplace_back(system(), AbstractSystem::ShapeTemp, ++mFinishedFileCount);
     
     auto f = m_finishedFiles.back().forWrite();
@@ -878,14 +1443,21 @@ RendererImpl::moveFinishedToFile()
     if (f && f->good()) {
         if (mFinishedShapes.size() > 10000)
             system()->message("Sorting shapes...");
-        std::sort(mFinishedShapes.begin(), mFinishedShapes.end());
+        {
+            PhaseScope sorting(*this, Stats::SortPhase, "sort");
+            std::sort(mFinishedShapes.begin(), mFinishedShapes.end());
+        }
         AbstractSystem::Stats outStats = m_stats;
         outStats.mSystem = system();
         outStats.outputCount = static_cast<int>(mFinishedShapes.size());
         outStats.outputDone = 0;
         outStats.showProgress = true;
+        std::size_t written = 0;
         for (const FinishedShape& fs: mFinishedShapes) {
-            *f << fs;
+            // Symmetry copies are written out as separate shapes
+            forEachInstance(fs, [&](const FinishedShape& s) {
+                OutputMerge::write(m_finishedFiles.back(), *f, s, written++);
+            });
             ++outStats.outputDone;
             if (requestUpdate) {
                 system()->stats(outStats);
@@ -899,8 +1471,19 @@ RendererImpl::moveFinishedToFile()
         requestStop = true;
         return;
     }
+    
+    auto pos = f->tellp();
+    if (pos > 0) {
+        m_stats.bytesSpilled += static_cast<unsigned long long>(pos);
+        m_finishedFiles.back().setBytes(static_cast<unsigned long long>(pos));
+    }
+    ++m_stats.spillFiles;
 
+    if (mMemReport)
+        memorySample();
     mFinishedShapes.clear();
+    mInstanceLists.clear();
+    mFinishedInstances = 0;
 }
 
 //-------------------------------------------------------------------------////
@@ -932,8 +1515,12 @@ void RendererImpl::rescaleOutput(int& curr_width, int& curr_height, bool final)
 
 
 void
-RendererImpl::forEachShape(bool final, ShapeFunction op)
+RendererImpl::forEachShape(bool final, ShapeFunction shapeOp)
 {
+    ShapeFunction op = [&](const FinishedShape& s) {
+        forEachInstance(s, shapeOp);
+    };
+    
     if (!final || m_finishedFiles.empty()) {
         FinishedContainer::iterator start = mFinishedShapes.begin();
         FinishedContainer::iterator last  = mFinishedShapes.end();
@@ -945,6 +1532,8 @@ RendererImpl::forEachShape(bool final, ShapeFunction op)
         std::deque<TempFile>::iterator begin, last, end;
         
         while (m_finishedFiles.size() > MaxMergeFiles) {
+            PhaseScope merging(*this, Stats::MergePhase, "merge pass");
+            ++m_stats.mergePasses;
             TempFile t(system(), AbstractSystem::MergeTemp, ++mFinishedFileCount);
             
             {
@@ -954,9 +1543,6 @@ RendererImpl::forEachShape(bool final, ShapeFunction op)
                 last = begin + (MaxMergeFiles - 1);
                 end = last + 1;
                 
-                for (auto it = begin; it != end; ++it)
-                    merger.addTempFile(*it);
-                
                 auto f = t.forWrite();
                 if (!f) {
                     system()->message("Cannot open temporary file for shapes");
@@ -966,23 +1552,84 @@ RendererImpl::forEachShape(bool final, ShapeFunction op)
                 system()->message("Merging temp files %d through %d",
                                   begin->number(), last->number());
                 
-                merger.merge([&](const FinishedShape& s) {
-                    *f << s;
-                });
+                std::size_t written = 0;
+                ShapeFunction writer = [&](const FinishedShape& s) {
+                    OutputMerge::write(t, *f, s, written++);
+                };
+                if (!OutputMerge::mergeParallel(begin, end, mFinishedShapes.end(),
+                                                 mFinishedShapes.end(), MergeThreads, writer)) {
+                    for (auto it = begin; it != end; ++it)
+                        merger.addTempFile(*it);
+                    merger.merge(writer);
+                }
+                
+                auto pos = f->tellp();
+                if (pos > 0) {
+                    m_stats.bytesSpilled += static_cast<unsigned long long>(pos);
+                    t.setBytes(static_cast<unsigned long long>(pos));
+                }
+                ++m_stats.spillFiles;
             }   // end scope for merger and f
             
             for (unsigned i = 0; i < MaxMergeFiles; ++i)
                 m_finishedFiles.pop_front();
             m_finishedFiles.push_back(std::move(t));
+            if (mMemReport)
+                memorySample();
         }
         
-        OutputMerge merger;
-        
-        for (auto&& file: m_finishedFiles)
-            merger.addTempFile(file);
+        auto finalMerge = [&](const ShapeFunction& consume) {
+            if (OutputMerge::mergeParallel(m_finishedFiles.begin(), m_finishedFiles.end(),
+                                           mFinishedShapes.begin(), mFinishedShapes.end(),
+                                           MergeThreads, consume))
+                return;
+            OutputMerge merger;
+            
+            for (auto&& file: m_finishedFiles)
+                merger.addTempFile(file);
+            
+            merger.addShapes(mFinishedShapes.begin(), mFinishedShapes.end());
+            merger.merge(consume);
+        };
         
-        merger.addShapes(mFinishedShapes.begin(), mFinishedShapes.end());
-        merger.merge(op);
+        ++m_stats.mergePasses;
+        if (m_stats.detailed && mCurrentPhase) {
+            // Time the consumer separately so that the merge phase only
+            // counts reading and ordering the shapes. Otherwise the final
+            // merge is counted as part of the caller's phase.
+            Stats::Phase consumer = mCurrentPhase->phase();
+            PhaseScope merging(*this, Stats::MergePhase, "final merge");
+            finalMerge([&](const FinishedShape& s) {
+                PhaseScope consuming(*this, consumer);
+                op(s);
+            });
+        } else {
+            finalMerge(op);
+        }
+    }
+}
+
+void
+RendererImpl::forEachInstance(const FinishedShape& s, const ShapeFunction& op)
+{
+    if (!s.mInstanceIndex) {
+        op(s);
+        return;
+    }
+    
+    // Rebuild each symmetry copy exactly as processPrimShape() computed it
+    FinishedShape copy;
+    copy.mShapeType = s.mShapeType;
+    copy.mAreaCache = s.mAreaCache;
+    copy.mParameters = s.mParameters;
+    for (const FinishedShape::Instance& instance: mInstanceLists[s.mInstanceIndex - 1]) {
+        copy.mWorldState = s.mWorldState;
+        copy.mWorldState.m_transform.multiply(mSymmetryOps[instance.mSymmetryOp]);
+        copy.mWorldState.m_ColorAssignment = instance.mOrder;
+        copy.mWorldState.m_Z.sz = instance.mArea;
+        copy.mWorldState.m_time.tbegin = instance.mTimeBegin;
+        copy.mBounds = instance.mBounds;
+        op(copy);
     }
 }
 
@@ -1042,6 +1689,8 @@ void RendererImpl::output(bool final)
         
     if (!final &&  !m_finishedFiles.empty())
         return; // don't do updates once we have temp files
+    
+    PhaseScope rasterizing(*this, Stats::RasterPhase, final ? "output" : "partial output");
         
     m_stats.inOutput = true;
     m_stats.fullOutput = final;
@@ -1058,6 +1707,7 @@ void RendererImpl::output(bool final)
     if (final) {
         if (mFinishedShapes.size() > 10000)
             system()->message("Sorting shapes...");
+        PhaseScope sorting(*this, Stats::SortPhase, "sort");
         std::sort(mFinishedShapes.begin(), mFinishedShapes.end());
     }
     
@@ -1075,8 +1725,13 @@ void RendererImpl::output(bool final)
     catch (std::exception& e) {
         system()->catastrophicError(e.what());
     }
+    if (mMemReport)
+        memorySample();
 
-    m_canvas->end();
+    {
+        PhaseScope encoding(*this, Stats::EncodePhase, "canvas end");
+        m_canvas->end();
+    }
     m_stats.inOutput = false;
     m_stats.outputTime = m_canvas->mTime;
 }
@@ -1085,6 +1740,12 @@ void RendererImpl::output(bool final)
 void
 RendererImpl::outputStats()
 {
+    m_stats.pathCacheHits = mPathCacheHits;
+    m_stats.pathCacheMisses = mPathCacheMisses;
+    m_stats.paramInternHits = mParamInternHits;
+    m_stats.paramInternMisses = mParamInternMisses;
+    m_stats.paramsLive = Renderer::ParamCount;
+    m_stats.paramsPeak = Renderer::ParamPeak;
     system()->stats(m_stats);
     requestUpdate = false;
 }
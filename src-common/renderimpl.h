@@ -50,8 +50,14 @@
 #include "CmdInfo.h"
 #include "pathIterator.h"
 #include "chunk_vector.h"
+#include "frontier.h"
+#include "ruleProfiler.h"
+#include "traceWriter.h"
+#include "memReport.h"
+#include "perfCounters.h"
 
 class ShapeOp;
+class PhaseScope;
 namespace AST {
     class ASTbodyContainer;
     class ASTrule;
@@ -67,6 +73,11 @@ class RendererImpl final : public RendererAST {
         ~RendererImpl() override;
     
         void setMaxShapes(int n) final;
+        void setFrontierTolerance(double t) final;
+        void setDetailedStats(bool on) final;
+        bool startTrace(const std::string& path) final;
+        bool startPerfCounters(std::string& error) final;
+        Estimate estimate(double sampleSeconds) final;
         void resetBounds() final;
         void resetSize(int x, int y) final;
         void initBounds();
@@ -74,6 +85,10 @@ class RendererImpl final : public RendererAST {
         double run(Canvas* canvas, bool partialDraw) final;
         void draw(Canvas* canvas) final;
         void animate(Canvas* canvas, int frames, int frame, bool zoom) final;
+        void profileRules(bool on) final;
+        void ruleProfile(std::ostream& table, std::ostream* folded) final;
+        void sampleMemory(bool on) final;
+        void memoryReport(std::ostream& out) final;
         void processPathCommand(const Shape& s, const AST::CommandInfo* attr) final;
         void processShape(Shape& s) final;
         void processPrimShape(Shape& s, const AST::ASTrule* path = nullptr) final;
@@ -83,7 +98,9 @@ class RendererImpl final : public RendererAST {
         void outputPrep(Canvas*);
         void rescaleOutput(int& curr_width, int& curr_height, bool final);
         void forEachShape(bool final, ShapeFunction op);
+        void forEachInstance(const FinishedShape& s, const ShapeFunction& op);
         void processPrimShapeSiblings(Shape&& s, const AST::ASTrule* path);
+        bool finishShape(Shape&& s, const AST::ASTrule* path, FinishedShape& fs);
         void drawShape(const FinishedShape& s);
 
         void output(bool final);
@@ -94,9 +111,11 @@ class RendererImpl final : public RendererAST {
         friend class OutputDraw;
         friend class OutputMerge;
         friend class OutputBounds;
+        friend class PhaseScope;
         
         bool isDone();
         void fileIfNecessary();
+        void releaseHeldShape();
         void moveFinishedToFile();
         void moveUnfinishedToTwoFiles();
         void getUnfinishedFromFile();
@@ -124,8 +143,20 @@ class RendererImpl final : public RendererAST {
 
         using FinishedContainer = chunk_vector<FinishedShape, 10>;
         FinishedContainer mFinishedShapes;
-        using UnfinishedContainer = chunk_vector<Shape, 10>;
+        std::vector<FinishedShape::InstanceList> mInstanceLists;  // see FinishedShape::mInstanceIndex
+        std::size_t mFinishedInstances = 0;     // symmetry copies in mFinishedShapes
+        // The frontier heap holds entries for shapes encoded in mFrontier
+        using UnfinishedContainer = chunk_vector<FrontierStore::Entry, 10>;
         UnfinishedContainer mUnfinishedShapes;
+        FrontierStore mFrontier;
+        void clearUnfinished();
+        std::size_t unfinishedBytes() const
+        { return mUnfinishedShapes.size() * sizeof(FrontierStore::Entry) + mFrontier.bytes(); }
+        // A lone child that run() would pop right after expanding its parent
+        // skips the frontier, see processShape() and releaseHeldShape()
+        Shape mHeldShape;
+        bool mHolding = false;
+        bool mCanHold = false;
 
         std::deque<TempFile> m_finishedFiles;
         std::deque<TempFile> m_unfinishedFiles;
@@ -158,14 +189,23 @@ class RendererImpl final : public RendererAST {
         std::vector<agg::trans_affine> mSymmetryOps;
 
         AbstractSystem::Stats m_stats;
+        PhaseScope* mCurrentPhase = nullptr;
         int m_unfinishedInFilesCount = 0;
     
+        std::unique_ptr<RuleProfiler> mProfiler;
+        std::unique_ptr<TraceWriter> mTrace;
+        void traceCounters();
+        std::unique_ptr<MemReport> mMemReport;
+        std::unique_ptr<PerfCounters> mPerf;
+        void memorySample();
+
         primShape::primShapes_t shapeCopies;
         std::array<AST::CommandInfo, primShape::numTypes> shapeMap;
     
         static unsigned int MoveFinishedAt;     // when this many, move to file
         static unsigned int MoveUnfinishedAt;   // when this many, move to files
         static unsigned int MaxMergeFiles;      // maximum number of files to merge at once
+        static unsigned int MergeThreads;       // threads for merging temp files
     
     protected:
         void colorConflict(const yy::location& w) final;
@@ -0,0 +1,223 @@
+// ruleProfiler.cpp
+// this file is part of Context Free
+// ---------------------
+// Copyright (C) 2026 John Horigan - john@glyphic.com
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+// John Horigan can be contacted at john@glyphic.com or at
+// John Horigan, 1209 Villa St., Mountain View, CA 94041-1123, USA
+//
+//
+
+
+#include "ruleProfiler.h"
+#include "cfdg.h"
+#include "cfdgimpl.h"
+#include "astreplacement.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <string>
+
+using namespace AST;
+
+RuleProfiler::RuleProfiler()
+: mRoot(nullptr, nullptr)
+{
+    mStack.reserve(16);
+}
+
+RuleProfiler::~RuleProfiler() = default;
+
+RuleProfiler::Node*
+RuleProfiler::Node::child(const ASTrule* r)
+{
+    auto& slot = children[r];
+    if (!slot)
+        slot = std::make_unique<Node>(r, this);
+    return slot.get();
+}
+
+bool
+RuleProfiler::enter(const ASTrule* rule)
+{
+    if (!mStack.empty() && mStack.back().node->rule == rule)
+        return false;
+    Node* parent = mStack.empty() ? &mRoot : mStack.back().node;
+    Node* node = parent->child(rule);
+    ++node->expansions;
+    mStack.push_back({node, clock::now(), clock::duration{0}, Renderer::ParamAllocs, 0});
+    return true;
+}
+
+void
+RuleProfiler::leave()
+{
+    if (mStack.empty()) return;
+    Frame f = mStack.back();
+    mStack.pop_back();
+
+    clock::duration elapsed = clock::now() - f.start;
+    unsigned long long allocs = Renderer::ParamAllocs - f.paramStart;
+    f.node->inclusive += elapsed;
+    f.node->self += elapsed - f.nested;
+    f.node->params += allocs - f.nestedParams;
+    if (!mStack.empty()) {
+        mStack.back().nested += elapsed;
+        mStack.back().nestedParams += allocs;
+    }
+}
+
+namespace {
+    struct RuleTotals {
+        std::uint64_t   expansions = 0;
+        std::uint64_t   finished = 0;
+        std::uint64_t   params = 0;
+        double          self = 0.0;
+        double          inclusive = 0.0;
+
+        void add(const RuleTotals& o)
+        {
+            expansions += o.expansions;
+            finished += o.finished;
+            params += o.params;
+            self += o.self;
+            inclusive += o.inclusive;
+        }
+    };
+
+    double msec(std::chrono::steady_clock::duration d)
+    {
+        return std::chrono::duration<double, std::milli>(d).count();
+    }
+
+    std::string where(const ASTrule* rule)
+    {
+        const yy::position& pos = rule->mLocation.begin;
+        std::string ret = pos.filename && !pos.filename->empty() ? *pos.filename : "cfdg text";
+        std::size_t dir = ret.find_last_of("/\\");
+        if (dir != std::string::npos)
+            ret.erase(0, dir + 1);
+        ret += ':';
+        ret += std::to_string(pos.line);
+        return ret;
+    }
+
+    // Flame graph frames cannot contain separators or spaces
+    std::string frameName(CFDGImpl& cfdg, const ASTrule* rule)
+    {
+        std::string ret = cfdg.decodeShapeName(rule->mNameIndex) + '@' + where(rule);
+        std::replace_if(ret.begin(), ret.end(),
+                        [](char c) { return c == ';' || c == ' '; }, '_');
+        return ret;
+    }
+}
+
+void
+RuleProfiler::report(std::ostream& table, std::ostream* folded, CFDGImpl& cfdg) const
+{
+    std::map<const ASTrule*, RuleTotals> rules;
+    std::map<int, RuleTotals> shapes;
+    std::map<std::string, double> stacks;
+
+    std::vector<std::pair<const Node*, std::string>> todo;
+    todo.emplace_back(&mRoot, std::string());
+    while (!todo.empty()) {
+        const Node* node = todo.back().first;
+        std::string path = std::move(todo.back().second);
+        todo.pop_back();
+
+        if (node->rule) {
+            RuleTotals t;
+            t.expansions = node->expansions;
+            t.finished = node->finished;
+            t.params = node->params;
+            t.self = msec(node->self);
+            t.inclusive = msec(node->inclusive);
+            rules[node->rule].add(t);
+            shapes[node->rule->mNameIndex].add(t);
+            if (!path.empty())
+                path += ';';
+            path += frameName(cfdg, node->rule);
+            stacks[path] += std::chrono::duration<double, std::micro>(node->self).count();
+        }
+
+        for (auto&& child: node->children)
+            todo.emplace_back(child.second.get(), path);
+    }
+
+    std::vector<std::pair<const ASTrule*, RuleTotals>> sorted(rules.begin(), rules.end());
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+        return a.second.inclusive > b.second.inclusive;
+    });
+
+    RuleTotals total;
+    for (auto&& shape: shapes)
+        total.add(shape.second);
+
+    char buf[256];
+    std::snprintf(buf, sizeof(buf), "Rule profile: %llu expansions, %.1f ms self time\n",
+                  static_cast<unsigned long long>(total.expansions), total.self);
+    table << buf;
+    std::snprintf(buf, sizeof(buf), "%12s %12s %12s %12s %12s  %s\n",
+                  "incl ms", "self ms", "expansions", "finished", "params", "rule");
+    table << buf;
+    for (auto&& entry: sorted) {
+        const ASTrule* rule = entry.first;
+        const RuleTotals& t = entry.second;
+        std::string name = cfdg.decodeShapeName(rule->mNameIndex);
+        if (rule->isPath)
+            name.insert(0, "path ");
+        if (rule->weightType != ASTrule::NoWeight) {
+            std::snprintf(buf, sizeof(buf), " %g%s", rule->mWeight,
+                          rule->weightType == ASTrule::PercentWeight ? "%" : "");
+            name += buf;
+        }
+        std::snprintf(buf, sizeof(buf), "%12.2f %12.2f %12llu %12llu %12llu  ",
+                      t.inclusive, t.self,
+                      static_cast<unsigned long long>(t.expansions),
+                      static_cast<unsigned long long>(t.finished),
+                      static_cast<unsigned long long>(t.params));
+        table << buf << name << " (" << where(rule) << ")\n";
+    }
+
+    if (shapes.size() < rules.size()) {
+        std::vector<std::pair<int, RuleTotals>> byShape(shapes.begin(), shapes.end());
+        std::sort(byShape.begin(), byShape.end(), [](const auto& a, const auto& b) {
+            return a.second.self > b.second.self;
+        });
+        table << "\nPer shape totals:\n";
+        std::snprintf(buf, sizeof(buf), "%12s %12s %12s %12s  %s\n",
+                      "self ms", "expansions", "finished", "params", "shape");
+        table << buf;
+        for (auto&& entry: byShape) {
+            const RuleTotals& t = entry.second;
+            std::snprintf(buf, sizeof(buf), "%12.2f %12llu %12llu %12llu  ", t.self,
+                          static_cast<unsigned long long>(t.expansions),
+                          static_cast<unsigned long long>(t.finished),
+                          static_cast<unsigned long long>(t.params));
+            table << buf << cfdg.decodeShapeName(entry.first) << '\n';
+        }
+    }
+
+    if (folded) {
+        for (auto&& stack: stacks)
+            if (stack.second >= 0.5)
+                *folded << stack.first << ' ' << static_cast<unsigned long long>(stack.second + 0.5) << '\n';
+    }
+}
@@ -0,0 +1,99 @@
+// ruleProfiler.h
+// this file is part of Context Free
+// ---------------------
+// Copyright (C) 2026 John Horigan - john@glyphic.com
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+// John Horigan can be contacted at john@glyphic.com or at
+// John Horigan, 1209 Villa St., Mountain View, CA 94041-1123, USA
+//
+//
+
+
+#ifndef INCLUDE_RULEPROFILER_H
+#define INCLUDE_RULEPROFILER_H
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+class CFDGImpl;
+namespace AST {
+    class ASTrule;
+}
+
+// Collects per-rule expansion statistics for --profile-rules. The renderer
+// only owns a RuleProfiler when profiling is requested, so the cost of the
+// hooks when profiling is off is a null pointer test.
+//
+// Expansions are not nested on the C++ stack (children go to the frontier),
+// so a profiler frame is a rule expansion plus any path rules that it runs
+// while finishing its primitive children. Self time excludes nested frames.
+
+class RuleProfiler
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    RuleProfiler();
+    ~RuleProfiler();
+    RuleProfiler(const RuleProfiler&) = delete;
+    RuleProfiler& operator=(const RuleProfiler&) = delete;
+
+    // Returns false if rule is already the innermost frame (a path rule
+    // reaching traversePath through its own traverseRule).
+    bool enter(const AST::ASTrule* rule);
+    void leave();
+    void finishedShape()
+    {
+        if (!mStack.empty()) ++mStack.back().node->finished;
+    }
+
+    // Prints a table sorted by inclusive time and optionally writes
+    // folded stacks (one "frame;frame;... microseconds" line per call path)
+    // suitable for flamegraph.pl and similar tools.
+    void report(std::ostream& table, std::ostream* folded, CFDGImpl& cfdg) const;
+
+private:
+    struct Node {
+        const AST::ASTrule* rule;
+        Node*               parent;
+        std::unordered_map<const AST::ASTrule*, std::unique_ptr<Node>> children;
+        std::uint64_t       expansions = 0;
+        std::uint64_t       finished = 0;
+        std::uint64_t       params = 0;
+        clock::duration     self{0};
+        clock::duration     inclusive{0};
+
+        Node(const AST::ASTrule* r, Node* p) : rule(r), parent(p) {}
+        Node* child(const AST::ASTrule* r);
+    };
+    struct Frame {
+        Node*               node;
+        clock::time_point   start;
+        clock::duration     nested;
+        unsigned long long  paramStart;
+        unsigned long long  nestedParams;
+    };
+
+    Node                mRoot;
+    std::vector<Frame>  mStack;
+};
+
+#endif // INCLUDE_RULEPROFILER_H
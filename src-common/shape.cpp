@@ -45,6 +45,7 @@
 #include <iostream>
 
 #include <cmath>
+#include <cstring>
 using std::isfinite;
 
 bool
@@ -69,6 +70,35 @@ Modification::isFinite() const
     ;
 }
 
+namespace {
+    // Bitwise, so that -0.0 is not taken for an identity 0.0
+    bool
+    is(double v, double identity)
+    {
+        return std::memcmp(&v, &identity, sizeof(double)) == 0;
+    }
+}
+
+unsigned
+Modification::parts() const
+{
+    unsigned ret = 0;
+    if (!is(m_transform.sx, 1.0) || !is(m_transform.shy, 0.0) ||
+        !is(m_transform.shx, 0.0) || !is(m_transform.sy, 1.0) ||
+        !is(m_transform.tx, 0.0) || !is(m_transform.ty, 0.0))
+        ret |= TransformPart;
+    if (!is(m_Z.sz, 1.0) || !is(m_Z.tz, 0.0))
+        ret |= ZPart;
+    if (!is(m_time.st, 1.0) || !is(m_time.tbegin, 0.0) || !is(m_time.tend, 0.0))
+        ret |= TimePart;
+    // HSBColor::Adjust() ignores the color assignment for zero adjustments
+    if (!is(m_Color.h, 0.0) || !is(m_Color.s, 0.0) || !is(m_Color.b, 0.0) ||
+        !is(m_Color.a, 0.0) || !is(m_ColorTarget.h, 0.0) || !is(m_ColorTarget.s, 0.0) ||
+        !is(m_ColorTarget.b, 0.0) || !is(m_ColorTarget.a, 0.0))
+        ret |= ColorPart;
+    return ret;
+}
+
 bool
 Modification::merge(const Modification& m)
 {
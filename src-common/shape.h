@@ -32,7 +32,9 @@
 
 #include <iostream>
 #include <cmath>
+#include <cstdint>
 #include <functional>
+#include <vector>
 
 #include "agg2/agg_math_stroke.h"
 #include "agg2/agg_trans_affine.h"
@@ -72,11 +74,30 @@ class Modification {
         }
         Modification& operator*=(const Modification& m)
         {
-            m_transform.premultiply(m.m_transform);
-            m_Z.premultiply(m.m_Z);
-            m_time.premultiply(m.m_time);
-            HSBColor::Adjust(m_Color, m_ColorTarget, m.m_Color, m.m_ColorTarget,
-                             m.m_ColorAssignment);
+            return compose(m, AllParts);
+        }
+    
+        // Parts of an adjustment that differ bitwise from the identity.
+        // compose() only needs the parts that parts() reports: composing
+        // with an identity part gives back the same values, except that a
+        // -0.0 becomes 0.0 and an infinity can become a NaN, which skipping
+        // the part leaves as they were.
+        enum Parts : unsigned {
+            TransformPart = 1, ZPart = 2, TimePart = 4, ColorPart = 8,
+            AllParts = TransformPart | ZPart | TimePart | ColorPart
+        };
+        unsigned parts() const;
+        Modification& compose(const Modification& m, unsigned parts)
+        {
+            if (parts & TransformPart)
+                m_transform.premultiply(m.m_transform);
+            if (parts & ZPart)
+                m_Z.premultiply(m.m_Z);
+            if (parts & TimePart)
+                m_time.premultiply(m.m_time);
+            if (parts & ColorPart)
+                HSBColor::Adjust(m_Color, m_ColorTarget, m.m_Color, m.m_ColorTarget,
+                                 m.m_ColorAssignment);
             mRand64Seed ^= m.mRand64Seed;
             if (m.m_BlendMode)
                 m_BlendMode = m.m_BlendMode;
@@ -89,6 +110,10 @@ class Modification {
 class ShapeBase {
 public: 
     int mShapeType = -1;
+    // For a finished shape, one plus the index of its symmetry copies in
+    // the renderer's instance table, or zero. It fills the padding ahead
+    // of mWorldState, so the shape layout does not change.
+    std::uint32_t mInstanceIndex = 0;
     Modification mWorldState;
     
     double mAreaCache;
@@ -154,6 +179,20 @@ protected:
 
 class FinishedShape : public Shape {
 public:
+    // With CF::Symmetry a primitive is stored once, untransformed by the
+    // symmetry group, with a record for each symmetry copy that was kept.
+    // The records live in the renderer, see mInstanceIndex.
+    // RendererImpl::forEachInstance() turns them back into shapes, which
+    // is also how they are written to temp files.
+    struct Instance {
+        unsigned mSymmetryOp;
+        unsigned mOrder;
+        double   mArea;
+        double   mTimeBegin;
+        Bounds   mBounds;
+    };
+    using InstanceList = std::vector<Instance>;
+    
     Bounds mBounds;
     FinishedShape() = default;
     FinishedShape(Shape&& s, int order, const Bounds& b) noexcept
@@ -171,6 +210,7 @@ public:
         mShapeType = o.mShapeType;
         mWorldState = o.mWorldState;
         mAreaCache = o.mAreaCache;
+        mInstanceIndex = o.mInstanceIndex;
         mParameters = o.mParameters;
         mBounds = o.mBounds;
         return *this;
@@ -180,6 +220,7 @@ public:
         mShapeType = o.mShapeType;
         mWorldState = o.mWorldState;
         mAreaCache = o.mAreaCache;
+        mInstanceIndex = o.mInstanceIndex;
         mParameters = std::move(o.mParameters);
         mBounds = o.mBounds;
         return *this;
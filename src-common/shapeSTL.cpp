@@ -28,25 +28,71 @@
 
 
 #include "shapeSTL.h"
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <exception>
 #include <limits>
+#include <mutex>
+#include <thread>
 
 
 void
-OutputMerge::addTempFile(TempFile& t)
+OutputMerge::setRange(const Key* lower, const Key* upper)
 {
-    mStreams.push_back(t.forRead());
-    mIters.push_back(FileIter(*(mStreams.back())));
-    
-    insertNext(mIters.size() - 1);
+    mHasLower = lower != nullptr;
+    mHasUpper = upper != nullptr;
+    if (lower) mLower = *lower;
+    if (upper) mUpper = *upper;
+}
+
+void
+OutputMerge::addTempFile(TempFile& t, bool announce)
+{
+    mStreams.push_back(t.forRead(announce));
+    if (mHasLower) {
+        // Seek to the last mark before the range, all shapes ahead of it
+        // are below the range too
+        auto& marks = t.marks();
+        auto mark = std::partition_point(marks.begin(), marks.end(),
+            [&](const TempFile::Mark& m) { return Key(m.mZ, m.mOrder) < mLower; });
+        if (mark != marks.begin())
+            mStreams.back()->seekg((mark - 1)->mOffset);
+    }
 }
 
 void
 OutputMerge::addShapes(ShapeIter begin, ShapeIter end)
 {
+    if (mHasLower)
+        begin = std::partition_point(begin, end,
+            [&](const FinishedShape& s) { return Key(s) < mLower; });
+    if (mHasUpper)
+        end = std::partition_point(begin, end,
+            [&](const FinishedShape& s) { return Key(s) < mUpper; });
     mShapesNext = begin;
     mShapesEnd = end;
+    mHasShapes = true;
+}
+
+void
+OutputMerge::prime()
+{
+    if (mPrimed)
+        return;
+    mPrimed = true;
     
-    insertNext(std::numeric_limits<std::size_t>::max());
+    for (std::size_t i = 0; i < mStreams.size(); ++i) {
+        mIters.emplace_back(*mStreams[i]);
+        if (mHasLower) {
+            FileIter& input = mIters.back();
+            while (input != mFileEnd && Key(*input) < mLower)
+                ++input;
+        }
+        insertNext(i);
+    }
+    if (mHasShapes)
+        insertNext(std::numeric_limits<std::size_t>::max());
 }
 
 void
@@ -59,8 +105,188 @@ OutputMerge::insertNext(std::size_t i)
     }
     else {
         FileIter& input = mIters[i];
-        if (input != mFileEnd) {
+        if (input != mFileEnd && (!mHasUpper || Key(*input) < mUpper)) {
             mSieve.insert(SievePair(*input++, i));
         }
     }
 }
+
+void
+OutputMerge::write(TempFile& t, std::ostream& os, const FinishedShape& s,
+                   std::size_t index)
+{
+    // Parameter blocks are reference counted and allocated without locking,
+    // and a NaN z breaks the ordering that ranges rely on
+    if (s.mParameters || std::isnan(s.mWorldState.m_Z.tz))
+        t.setMergeSerially();
+    if (index % MarkEvery == 0) {
+        auto pos = os.tellp();
+        if (pos >= 0)
+            t.mark({s.mWorldState.m_Z.tz, s.mWorldState.m_ColorAssignment,
+                    static_cast<std::streamoff>(pos)});
+    }
+    os << s;
+}
+
+namespace {
+    // Hands merged shapes from a range worker to the consuming thread in
+    // batches, holding at most MaxBatches at a time
+    struct RangeChannel {
+        enum : std::size_t { BatchSize = 512, MaxBatches = 8 };
+        using Batch = std::vector<FinishedShape>;
+        
+        std::mutex              mMutex;
+        std::condition_variable mChanged;
+        std::deque<Batch>       mBatches;
+        bool                    mDone = false;
+        bool                    mStop = false;
+        std::exception_ptr      mError;
+        
+        // Worker side, false if the consumer has gone away
+        bool push(Batch&& b)
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mChanged.wait(lock, [&]{ return mStop || mBatches.size() < MaxBatches; });
+            if (mStop)
+                return false;
+            mBatches.push_back(std::move(b));
+            mChanged.notify_all();
+            return true;
+        }
+        void finish(std::exception_ptr e)
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mDone = true;
+            mError = e;
+            mChanged.notify_all();
+        }
+        // Consumer side, false when the range is exhausted
+        bool pop(Batch& b)
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mChanged.wait(lock, [&]{ return mDone || !mBatches.empty(); });
+            if (mBatches.empty()) {
+                if (mError)
+                    std::rethrow_exception(mError);
+                return false;
+            }
+            b = std::move(mBatches.front());
+            mBatches.pop_front();
+            mChanged.notify_all();
+            return true;
+        }
+        void stop()
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+            mChanged.notify_all();
+        }
+    };
+    
+    struct Stopped {};
+}
+
+bool
+OutputMerge::mergeParallel(TempIter filesBegin, TempIter filesEnd,
+                           ShapeIter shapesBegin, ShapeIter shapesEnd,
+                           unsigned threads, const ShapeFunction& op)
+{
+    if (threads < 2)
+        return false;
+    
+    // Sample the keys from the temp file marks and from the in-memory shapes
+    // at the same spacing
+    std::vector<Key> samples;
+    for (auto file = filesBegin; file != filesEnd; ++file) {
+        if (file->mergeSerially())
+            return false;
+        for (auto&& mark: file->marks())
+            samples.emplace_back(mark.mZ, mark.mOrder);
+    }
+    std::size_t index = 0;
+    for (auto shape = shapesBegin; shape != shapesEnd; ++shape, ++index) {
+        if (shape->mParameters || std::isnan(shape->mWorldState.m_Z.tz))
+            return false;
+        if (index % MarkEvery == 0)
+            samples.emplace_back(*shape);
+    }
+    
+    // Each range should span a few samples, or the seek granularity
+    // dominates the work
+    std::size_t ranges = std::min<std::size_t>(threads, samples.size() / 4);
+    // Every range opens every temp file
+    std::size_t files = static_cast<std::size_t>(filesEnd - filesBegin);
+    if (files)
+        ranges = std::min<std::size_t>(ranges, MaxOpenFiles / files);
+    if (ranges < 2)
+        return false;
+    std::sort(samples.begin(), samples.end());
+    std::vector<Key> splitters;
+    for (std::size_t r = 1; r < ranges; ++r) {
+        const Key& k = samples[r * samples.size() / ranges];
+        if (splitters.empty() || splitters.back() < k)
+            splitters.push_back(k);
+    }
+    ranges = splitters.size() + 1;
+    
+    // Open the inputs of every range here, the workers only read them
+    std::vector<std::unique_ptr<OutputMerge>> mergers;
+    std::vector<std::unique_ptr<RangeChannel>> channels;
+    for (std::size_t r = 0; r < ranges; ++r) {
+        mergers.push_back(std::make_unique<OutputMerge>());
+        channels.push_back(std::make_unique<RangeChannel>());
+        OutputMerge& m = *mergers.back();
+        m.setRange(r ? &splitters[r - 1] : nullptr,
+                   r < splitters.size() ? &splitters[r] : nullptr);
+        for (auto file = filesBegin; file != filesEnd; ++file)
+            m.addTempFile(*file, r == 0);
+        m.addShapes(shapesBegin, shapesEnd);
+    }
+    
+    std::vector<std::thread> workers;
+    auto joinAll = [&]() {
+        for (auto&& channel: channels)
+            channel->stop();
+        for (auto&& worker: workers)
+            if (worker.joinable())
+                worker.join();
+    };
+    
+    try {
+        for (std::size_t r = 0; r < ranges; ++r) {
+            workers.emplace_back([](OutputMerge* m, RangeChannel* channel) {
+                std::exception_ptr error;
+                try {
+                    RangeChannel::Batch batch;
+                    batch.reserve(RangeChannel::BatchSize);
+                    m->merge([&](const FinishedShape& s) {
+                        batch.push_back(s);
+                        if (batch.size() == RangeChannel::BatchSize) {
+                            if (!channel->push(std::move(batch)))
+                                throw Stopped();
+                            batch = RangeChannel::Batch();
+                            batch.reserve(RangeChannel::BatchSize);
+                        }
+                    });
+                    if (!batch.empty())
+                        channel->push(std::move(batch));
+                } catch (Stopped&) {
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                channel->finish(error);
+            }, mergers[r].get(), channels[r].get());
+        }
+        
+        RangeChannel::Batch batch;
+        for (auto&& channel: channels)
+            while (channel->pop(batch))
+                for (const FinishedShape& s: batch)
+                    op(s);
+    } catch (...) {
+        joinAll();
+        throw;
+    }
+    joinAll();
+    return true;
+}
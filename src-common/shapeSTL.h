@@ -34,6 +34,7 @@
 #pragma warning( disable : 4786 )
 #endif
 
+#include <deque>
 #include <functional>
 #include <iostream>
 #include <iterator>
@@ -57,14 +58,32 @@ public:
     
     using ShapeSource = chunk_vector<FinishedShape, 10>;
     using ShapeIter   = ShapeSource::iterator;
+    using TempIter    = std::deque<TempFile>::iterator;
+    
+    // The merge order of finished shapes, same as FinishedShape::operator<
+    struct Key {
+        double      mZ;
+        unsigned    mOrder;
+        
+        Key(double z, unsigned order) : mZ(z), mOrder(order) {}
+        explicit Key(const FinishedShape& s)
+        : mZ(s.mWorldState.m_Z.tz), mOrder(s.mWorldState.m_ColorAssignment) {}
+        bool operator<(const Key& b) const
+        { return (mZ == b.mZ) ? (mOrder < b.mOrder) : (mZ < b.mZ); }
+    };
+    
+    // Only merge shapes with lower <= key < upper, nullptr for no limit.
+    // Must be set before adding shapes or temp files.
+    void setRange(const Key* lower, const Key* upper);
     
     void addShapes(ShapeIter begin, ShapeIter end);
 
-    void addTempFile(TempFile&);
+    void addTempFile(TempFile&, bool announce = true);
 
 
     void merge(ShapeFunction op)
     {
+        prime();
         while (!mSieve.empty()) {
             auto nextShape = mSieve.begin();
             
@@ -76,6 +95,22 @@ public:
         }
     }
     
+    // Writes the next shape of a sorted temp file, index counts the shapes
+    // written so far. Every MarkEvery shapes the key and file offset is
+    // recorded so that a merge of a key range can seek past earlier shapes.
+    static void write(TempFile& t, std::ostream& os, const FinishedShape& s,
+                      std::size_t index);
+    
+    // Merges the temp files and shapes by splitting the keys into ranges at
+    // sampled splitters and merging each range on its own thread. op is
+    // called on the calling thread in merge order, so the output is the
+    // same as a serial merge. Returns false without calling op if the input
+    // is too small to split or has shapes that must be merged serially.
+    static bool mergeParallel(TempIter filesBegin, TempIter filesEnd,
+                              ShapeIter shapesBegin, ShapeIter shapesEnd,
+                              unsigned threads, const ShapeFunction& op);
+    
+    enum : std::size_t { MarkEvery = 256, MaxOpenFiles = 512 };
     
 private:
     using file_ptr    = AbstractSystem::istr_ptr;
@@ -90,12 +125,20 @@ private:
     
     ShapeIter   mShapesNext;
     ShapeIter   mShapesEnd;
+    bool        mHasShapes = false;
+    bool        mPrimed = false;
+    
+    bool        mHasLower = false;
+    bool        mHasUpper = false;
+    Key         mLower = Key(0.0, 0);
+    Key         mUpper = Key(0.0, 0);
 
     using Sieve     = std::map<FinishedShape, std::size_t>;
     using SievePair = Sieve::value_type;
     
     Sieve       mSieve;
     
+    void prime();
     void insertNext(std::size_t i);
 };
 
@@ -76,6 +76,13 @@ StackRule*
 StackRule::alloc(int name, int size, const AST::ASTparameters* ti)
 {
     ++Renderer::ParamCount;
+    if (Renderer::ParamStats) {
+        if (Renderer::ParamCount > Renderer::ParamPeak)
+            Renderer::ParamPeak = Renderer::ParamCount;
+        ++Renderer::ParamAllocs;
+        ++Renderer::ParamSizes[Renderer::ParamSizeBucket(size)];
+        Renderer::ParamBytes += (size ? size + HeaderSize : 1) * sizeof(StackType);
+    }
     StackType* newrule = size ? new StackType[size + HeaderSize] : new StackType;
     assert((reinterpret_cast<intptr_t>(newrule) & 3) == 0);   // confirm 32-bit alignment
     newrule[0].ruleHeader.mRuleName = static_cast<std::int16_t>(name);
@@ -156,6 +163,8 @@ StackRule::release() const noexcept
         (*f).second = -n;
 #endif
         --Renderer::ParamCount;
+        if (Renderer::ParamStats)
+            Renderer::ParamBytes -= (mParamCount ? mParamCount + HeaderSize : 1) * sizeof(StackType);
         if (mParamCount)
             delete[] data;
         else
@@ -206,6 +215,43 @@ StackRule::Equal(const StackRule* a, const StackRule* b)
     return (*a) == (*b);
 }
 
+bool
+StackRule::Identical(const StackRule* a, const StackRule* b)
+{
+    if (a == b) return true;
+    if (a == nullptr || b == nullptr) return false;
+    if (a->mRuleName != b->mRuleName || a->mParamCount != b->mParamCount)
+        return false;
+    if (a->mParamCount == 0) return true;
+    auto sa = reinterpret_cast<const StackType*>(a);
+    auto sb = reinterpret_cast<const StackType*>(b);
+    return sa[1].typeInfo == sb[1].typeInfo && *a == *b;
+}
+
+std::size_t
+StackRule::Hash(const StackRule* r)
+{
+    if (r == nullptr) return 0;
+    // FNV-1a over the rule name, type info and parameter words
+    std::uint64_t h = 14695981039346656037ULL;
+    auto mix = [&h](std::uint64_t v) {
+        h ^= v;
+        h *= 1099511628211ULL;
+    };
+    mix(static_cast<std::uint64_t>(static_cast<std::uint16_t>(r->mRuleName)) << 16 |
+        r->mParamCount);
+    if (r->mParamCount) {
+        auto st = reinterpret_cast<const StackType*>(r);
+        mix(static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(st[1].typeInfo)));
+        for (std::size_t i = HeaderSize; i < HeaderSize + r->mParamCount; ++i) {
+            std::uint64_t word;
+            std::memcpy(&word, st + i, sizeof(word));
+            mix(word);
+        }
+    }
+    return static_cast<std::size_t>(h ^ (h >> 32));
+}
+
 void
 StackRule::read(std::istream& is)
 {
@@ -158,6 +158,10 @@ struct StackRule {
     
     bool operator==(const StackRule& o) const;
     static bool Equal(const StackRule* a, const StackRule* b);
+    // Same rule, parameter types and parameter words, so either block can
+    // stand in for the other
+    static bool Identical(const StackRule* a, const StackRule* b);
+    static std::size_t Hash(const StackRule* r);
     
     static StackRule*  alloc(int name, int size, const AST::ASTparameters* ti);
     static StackRule*  alloc(const StackRule* from, int newName = -1);
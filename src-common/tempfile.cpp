@@ -52,11 +52,12 @@ TempFile::forWrite()
 }
 
 AbstractSystem::istr_ptr
-TempFile::forRead()
+TempFile::forRead(bool announce)
 {
     if (!mWritten)
         mSystem->message("TempFile::forRead temp file never written, " FileFormat "\n", mPath.c_str());
-    mSystem->message("Reading %s temp file %d", type().c_str(), mNum);
+    if (announce)
+        mSystem->message("Reading %s temp file %d", type().c_str(), mNum);
     return mSystem->tempFileForRead(mPath);
 }
 
@@ -77,7 +78,8 @@ TempFile::TempFile(AbstractSystem* system, AbstractSystem::TempType type, int nu
 
 TempFile::TempFile(TempFile&& from) noexcept
 : mSystem(from.mSystem), mPath(std::move(from.mPath)), mType(std::move(from.mType)),
-  mNum(from.mNum), mWritten(from.mWritten)
+  mNum(from.mNum), mWritten(from.mWritten), mBytes(from.mBytes),
+  mMarks(std::move(from.mMarks)), mMergeSerially(from.mMergeSerially)
 {
     // Prevent old TempFile from triggering an unlink
     from.mWritten = false;
@@ -95,6 +97,9 @@ TempFile::operator=(TempFile&& from) noexcept
     mType = from.mType;
     mNum = from.mNum;
     mWritten = from.mWritten;
+    mBytes = from.mBytes;
+    mMarks = std::move(from.mMarks);
+    mMergeSerially = from.mMergeSerially;
     // Prevent old TempFile from triggering an unlink
     from.mWritten = false;
     from.mPath.clear();
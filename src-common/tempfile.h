@@ -31,18 +31,34 @@
 #define INCLUDE_TEMPFILE_H
 
 #include "cfdg.h"
+#include <ios>
+#include <vector>
 
 class TempFile
 {
 public:
     AbstractSystem::ostr_ptr forWrite();
-    AbstractSystem::istr_ptr forRead();
+    AbstractSystem::istr_ptr forRead(bool announce = true);
 
     const std::string& type() const;
     const AbstractSystem::FileString& name() const { return mPath; }
     int         number() const { return mNum; }
     void        release() { mWritten = false; }
     bool        written() const { return mWritten; }
+    unsigned long long bytes() const { return mBytes; }
+    void        setBytes(unsigned long long b) { mBytes = b; }
+    
+    // Sparse index of a file of sorted shapes: the sort key and offset of
+    // every so many shapes, see OutputMerge::write()
+    struct Mark {
+        double          mZ;
+        unsigned        mOrder;
+        std::streamoff  mOffset;
+    };
+    const std::vector<Mark>& marks() const { return mMarks; }
+    void        mark(const Mark& m) { mMarks.push_back(m); }
+    bool        mergeSerially() const { return mMergeSerially; }
+    void        setMergeSerially() { mMergeSerially = true; }
     
     TempFile(AbstractSystem*, AbstractSystem::TempType type, int num);
     TempFile(TempFile&&) noexcept;
@@ -57,6 +73,9 @@ private:
     AbstractSystem::TempType mType;
     int         mNum;
     bool        mWritten;
+    unsigned long long mBytes = 0;
+    std::vector<Mark> mMarks;
+    bool        mMergeSerially = false;
     void        erase();
 };
 
@@ -42,6 +42,7 @@ public:
     
     void primitive(int shape, RGBA8 c, agg::trans_affine tr, agg::comp_op_e blend) override;
     void path(RGBA8 c, agg::trans_affine tr, const AST::CommandInfo& attr) override;
+    std::size_t bufferBytes() const override { return mTile->bufferBytes(); }
     
     tiledCanvas(Canvas* tile, const agg::trans_affine& tr, CFDG::frieze_t f); 
     ~tiledCanvas() override = default;
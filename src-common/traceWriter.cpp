@@ -0,0 +1,128 @@
+// traceWriter.cpp
+// this file is part of Context Free
+// ---------------------
+// Copyright (C) 2026 John Horigan - john@glyphic.com
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+// John Horigan can be contacted at john@glyphic.com or at
+// John Horigan, 1209 Villa St., Mountain View, CA 94041-1123, USA
+//
+//
+
+
+
+#include "traceWriter.h"
+#include <algorithm>
+#include <cstdio>
+
+TraceWriter::TraceWriter(const std::string& path)
+: mFile(path), mGood(false), mEpoch(clock::now()), mRing(new Event[Capacity])
+{
+    if (!mFile)
+        return;
+    mGood = true;
+    mFile << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    mThread = std::thread(&TraceWriter::run, this);
+}
+
+TraceWriter::~TraceWriter()
+{
+    if (!mGood)
+        return;
+    mDone = true;
+    mThread.join();
+    drain();
+    mFile << "\n],\"otherData\":{\"droppedEvents\":" << mDropped << "}}\n";
+}
+
+void
+TraceWriter::push(const Event& e)
+{
+    std::size_t head = mHead.load(std::memory_order_relaxed);
+    if (head - mTail.load(std::memory_order_acquire) >= Capacity) {
+        ++mDropped;
+        return;
+    }
+    mRing[head & (Capacity - 1)] = e;
+    mHead.store(head + 1, std::memory_order_release);
+}
+
+void
+TraceWriter::complete(const char* name, clock::time_point start, clock::time_point end)
+{
+    if (mGood)
+        push({name, since(start), since(end) - since(start), 0.0, 'X', false});
+}
+
+void
+TraceWriter::complete(const char* name, clock::time_point start, clock::time_point end,
+                      double arg)
+{
+    if (mGood)
+        push({name, since(start), since(end) - since(start), arg, 'X', true});
+}
+
+void
+TraceWriter::counter(const char* name, double value)
+{
+    if (mGood)
+        push({name, since(clock::now()), 0, value, 'C', true});
+}
+
+bool
+TraceWriter::drain()
+{
+    std::size_t tail = mTail.load(std::memory_order_relaxed);
+    std::size_t head = mHead.load(std::memory_order_acquire);
+    if (tail == head)
+        return false;
+
+    char buf[256];
+    for (; tail != head; ++tail) {
+        const Event& e = mRing[tail & (Capacity - 1)];
+        int len;
+        if (e.type == 'C') {
+            len = std::snprintf(buf, sizeof(buf),
+                "%s{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":1,"
+                "\"args\":{\"value\":%.17g}}", mFirst ? "" : ",\n",
+                e.name, e.ts * 0.001, e.value);
+        } else if (e.hasArg) {
+            len = std::snprintf(buf, sizeof(buf),
+                "%s{\"name\":\"%s\",\"cat\":\"cfdg\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                "\"pid\":1,\"tid\":1,\"args\":{\"value\":%.17g}}", mFirst ? "" : ",\n",
+                e.name, e.ts * 0.001, e.dur * 0.001, e.value);
+        } else {
+            len = std::snprintf(buf, sizeof(buf),
+                "%s{\"name\":\"%s\",\"cat\":\"cfdg\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                "\"pid\":1,\"tid\":1}", mFirst ? "" : ",\n",
+                e.name, e.ts * 0.001, e.dur * 0.001);
+        }
+        mFirst = false;
+        if (len > 0)
+            mFile.write(buf, std::min(len, static_cast<int>(sizeof(buf)) - 1));
+    }
+    mTail.store(tail, std::memory_order_release);
+    return true;
+}
+
+void
+TraceWriter::run()
+{
+    while (!mDone.load(std::memory_order_acquire)) {
+        if (!drain())
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
@@ -0,0 +1,119 @@
+// traceWriter.h
+// this file is part of Context Free
+// ---------------------
+// Copyright (C) 2026 John Horigan - john@glyphic.com
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+// John Horigan can be contacted at john@glyphic.com or at
+// John Horigan, 1209 Villa St., Mountain View, CA 94041-1123, USA
+//
+//
+
+
+
+#ifndef INCLUDE_TRACEWRITER_H
+#define INCLUDE_TRACEWRITER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+
+// Writes a Chrome trace-event JSON file (chrome://tracing, Perfetto) of
+// render phases. Events are queued by the rendering thread in a fixed-size
+// single-producer/single-consumer ring buffer and written to the file by a
+// background thread, so recording an event is a few stores and never
+// blocks. If the writer falls behind, events are dropped and counted. Event
+// names must be string literals (or otherwise outlive the writer).
+
+class TraceWriter
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    explicit TraceWriter(const std::string& path);
+    ~TraceWriter();
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    bool good() const { return mGood; }
+
+    // Rendering thread only
+    void complete(const char* name, clock::time_point start, clock::time_point end);
+    void complete(const char* name, clock::time_point start, clock::time_point end,
+                  double arg);
+    void counter(const char* name, double value);
+
+private:
+    struct Event {
+        const char*     name;
+        std::int64_t    ts;         // nanoseconds since the trace started
+        std::int64_t    dur;
+        double          value;
+        char            type;       // 'X' complete, 'C' counter
+        bool            hasArg;
+    };
+    static constexpr std::size_t Capacity = 1 << 16;    // power of two
+
+    std::int64_t since(clock::time_point t) const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(t - mEpoch).count();
+    }
+    void push(const Event& e);
+    bool drain();
+    void run();
+
+    std::ofstream                   mFile;
+    bool                            mGood;
+    bool                            mFirst = true;
+    clock::time_point               mEpoch;
+    std::unique_ptr<Event[]>        mRing;
+    alignas(64) std::atomic<std::size_t> mHead{0};     // written by producer
+    alignas(64) std::atomic<std::size_t> mTail{0};     // written by consumer
+    std::atomic_bool                mDone{false};
+    std::uint64_t                   mDropped = 0;      // producer only
+    std::thread                     mThread;
+};
+
+// Records a complete event for the lifetime of the scope, if tracing
+class TraceSpan
+{
+public:
+    TraceSpan(TraceWriter* t, const char* name, double arg)
+    : mTrace(t), mName(name), mArg(arg)
+    {
+        if (t) mStart = TraceWriter::clock::now();
+    }
+    ~TraceSpan()
+    {
+        if (mTrace)
+            mTrace->complete(mName, mStart, TraceWriter::clock::now(), mArg);
+    }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    TraceWriter*                mTrace;
+    const char*                 mName;
+    double                      mArg;
+    TraceWriter::clock::time_point mStart;
+};
+
+#endif // INCLUDE_TRACEWRITER_H
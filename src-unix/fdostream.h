@@ -70,6 +70,18 @@ namespace boost {
                                 std::streamsize num) {
             return write(fd,s,num);
         }
+        // position the file descriptor, output is unbuffered
+        virtual
+        pos_type seekoff (off_type off, std::ios_base::seekdir dir,
+                          std::ios_base::openmode) {
+            int whence = dir == std::ios_base::beg ? SEEK_SET :
+                         dir == std::ios_base::cur ? SEEK_CUR : SEEK_END;
+            return pos_type(static_cast<off_type>(lseek(fd, off, whence)));
+        }
+        virtual
+        pos_type seekpos (pos_type pos, std::ios_base::openmode which) {
+            return seekoff(off_type(pos), std::ios_base::beg, which);
+        }
     };
     
     class fdostream : public std::ostream {
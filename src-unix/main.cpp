@@ -31,6 +31,7 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <iomanip>
 #include <time.h>
 #include "args.hxx"
 #include <cstdlib>
@@ -53,6 +54,8 @@
 #include <string>
 #include "astexpression.h"
 #include "prettyint.h"
+#include "json3.hpp"
+#include <chrono>
 
 using std::string;
 using std::cerr;
@@ -108,6 +111,7 @@ struct options {
     int   widthMult;
     int   heightMult;
     int   maxShapes;
+    double frontierTolerance;
     double minSize;
     double borderSize;
     std::string definitions;
@@ -134,14 +138,23 @@ struct options {
     bool outputWallpaper;
     bool paramTest;
     bool deleteTemps;
+    bool profileRules;
+    std::string profileFolded;
+    std::string statsJson;
+    bool statsDetailed;
+    std::string traceFile;
+    bool memReport;
+    bool perfCounters;
+    bool estimate;
     
     options()
     : width(500), height(500), widthMult(1), heightMult(1), maxShapes(0), 
-      minSize(0.3F), borderSize(2.0F), variation(-1), crop(false), check(false), 
+      frontierTolerance(0.0), minSize(0.3F), borderSize(2.0F), variation(-1), crop(false), check(false), 
       animationFrames(0), animationTime(0), animationFPS(15), animationZoom(false), 
       animateFrame(0), animationCodec(ffCanvas::H264), format(PNGfile), quiet(false),
       outputTime(false), outputStdout(false), outputTemp(false), outputWallpaper(false),
-      paramTest(false), deleteTemps(false)
+      paramTest(false), deleteTemps(false), profileRules(false), statsDetailed(false),
+      memReport(false), perfCounters(false), estimate(false)
     { }
 };
 
@@ -208,6 +221,11 @@ processCommandLine(int argc, char* argv[], options& opt)
                                        "-1=-8 pixel border, 0=no border, 1=8 pixel "
                                        "border, 2=variable-sized border",
                                        {'b', "bordersize"}, 2.0);
+    args::ValueFlag<double> frontierTolerance(parser, "TOLERANCE",
+                                              "Relative error allowed when storing pending "
+                                              "shapes compactly, which also keeps more of them "
+                                              "in memory (default 0, exact)",
+                                              {"frontier-tolerance"}, 0.0);
     args::ValueFlag<string> variation(parser, "VARIATION",
         "Set the variation code (default is random)", {'v', "variation"}, "");
     args::ValueFlagList<string> definition(parser, "NAME=VALUE",
@@ -237,10 +255,26 @@ processCommandLine(int argc, char* argv[], options& opt)
     args::Flag crop(parser, "crop", "Crop output", {'c', "crop"});
     args::Flag quiet(parser, "quiet", "Quiet mode, suppress non-error output", {'q', "quiet"});
     args::Flag check(parser, "check", "Check syntax of cfdg file and exit", {'C', "check"});
+    args::Flag estimate(parser, "estimate", "Predict the shape count, memory, temp file use "
+        "and time of the render from a short sample, and exit", {"estimate"});
     args::Flag timer(parser, "time", "Output the time taken to render the cfdg file", {'t', "time"});
     args::Flag paramDebug(parser, "param debug", "Parameter allocation debug, test "
         "whether all the parameter blocks were cleaned up", {'P', "paramdebug"});
     args::Flag cleanup(parser, "cleanup", "Delete old temporary files", {'d', "cleanup"});
+    args::Flag profileRules(parser, "profile rules", "Print expansion counts and times for each rule",
+                            {"profile-rules"});
+    args::ValueFlag<string> profileFolded(parser, "FILE", "Profile rules and write folded "
+        "stacks to FILE for flame graph tools", {"profile-folded"}, "");
+    args::ValueFlag<string> statsJson(parser, "FILE", "Write render phase timings and "
+        "counters to FILE as JSON", {"stats-json"}, "");
+    args::Flag statsDetailed(parser, "detailed stats", "Also time individual heap "
+        "operations and separate merging from drawing (slower)", {"stats-detailed"});
+    args::ValueFlag<string> traceFile(parser, "FILE", "Write a Chrome trace-event timeline "
+        "of the render phases to FILE", {"trace"}, "");
+    args::Flag memReport(parser, "memory report", "Print peak memory use and a memory "
+        "timeline of the render", {"mem-report"});
+    args::Flag perfCounters(parser, "perf counters", "Count cycles, instructions, cache "
+        "misses and branch misses in each render phase (Linux only)", {"perf-counters"});
     args::Positional<std::string> inputFile(parser, "CFDG FILE", "Input cfdg file", "");
     args::Positional<std::string> outputFile(parser, "OUTPUT FILE", "Output image file", "");
     
@@ -284,6 +318,11 @@ processCommandLine(int argc, char* argv[], options& opt)
         if (opt.borderSize < -1.0 || opt.borderSize > 2.0)
             bailout("Border size must be between -1 and 2");
     }
+    if (frontierTolerance) {
+        opt.frontierTolerance = args::get(frontierTolerance);
+        if (opt.frontierTolerance < 0.0 || opt.frontierTolerance >= 1.0)
+            bailout("Frontier tolerance must be at least 0 and less than 1");
+    }
     if (variation) {
         opt.variation = Variation::fromString(args::get(variation).c_str());
         if (opt.variation == -1)
@@ -354,10 +393,20 @@ processCommandLine(int argc, char* argv[], options& opt)
     if (makeJSON) opt.format = options::JSONfile;
     opt.crop = crop;
     opt.check = check;
+    opt.estimate = estimate;
     opt.quiet = quiet;
     opt.outputTime = timer;
     opt.paramTest = paramDebug;
     opt.deleteTemps = cleanup;
+    opt.profileRules = profileRules || profileFolded;
+    if (profileFolded) opt.profileFolded = args::get(profileFolded);
+    if (statsJson) opt.statsJson = args::get(statsJson);
+    opt.statsDetailed = statsDetailed;
+    if (traceFile) opt.traceFile = args::get(traceFile);
+    opt.memReport = memReport;
+    opt.perfCounters = perfCounters;
+    if (statsDetailed && !statsJson)
+        bailout("Detailed stats are only collected for --stats-json.");
     if (quiet && cleanup)
         bailout("Cannot clean up temporary files quietly.");
     if (inputFile) opt.input = args::get(inputFile);
@@ -386,7 +435,9 @@ processCommandLine(int argc, char* argv[], options& opt)
         bailout("Missing input file.");
     if (!outputFile && !outputFileTemplate && display) 
         opt.outputTemp = true;
-    if ((!outputFile || opt.output == "-") && !outputFileTemplate && !check && !opt.outputTemp) {
+    if ((!outputFile || opt.output == "-") && !outputFileTemplate && !check && !estimate &&
+        !opt.outputTemp)
+    {
         opt.outputStdout = true;
         opt.output = "-";
         opt.quiet = true;
@@ -406,6 +457,129 @@ public:
 
 static nullostream cnull;
 
+static const double EstimateSeconds = 0.25;   // sample expansion time for --estimate
+
+static void
+writeStatsJson(const options& opts, const std::string& code,
+               const AbstractSystem::Stats& stats, double parseTime, double totalTime)
+{
+    nlohmann::json j;
+    j["input"] = opts.input;
+    j["variation"] = code;
+    j["width"] = opts.width;
+    j["height"] = opts.height;
+    j["shapes"] = stats.shapeCount;
+    j["wall"] = totalTime;
+    j["detailed"] = stats.detailed;
+    
+    nlohmann::json phases;
+    phases["parse"] = parseTime;
+    for (int i = 0; i < AbstractSystem::Stats::NumberOfPhases; ++i)
+        phases[AbstractSystem::Stats::PhaseNames[i]] = stats.phaseTime[i];
+    j["phases"] = phases;
+    
+    nlohmann::json counters;
+    counters["bytes_spilled"] = stats.bytesSpilled;
+    counters["spill_files"] = stats.spillFiles;
+    counters["merge_passes"] = stats.mergePasses;
+    counters["path_cache_hits"] = stats.pathCacheHits;
+    counters["path_cache_misses"] = stats.pathCacheMisses;
+    counters["param_intern_hits"] = stats.paramInternHits;
+    counters["param_intern_misses"] = stats.paramInternMisses;
+    counters["params_live"] = stats.paramsLive;
+    counters["params_peak"] = stats.paramsPeak;
+    counters["param_allocs"] = Renderer::ParamAllocs;
+    j["counters"] = counters;
+    
+    if (stats.counterMask) {
+        nlohmann::json perf;
+        for (int i = 0; i < AbstractSystem::Stats::NumberOfPhases; ++i) {
+            nlohmann::json phase;
+            for (int c = 0; c < AbstractSystem::Stats::NumberOfCounters; ++c)
+                if (stats.counterMask & (1u << c))
+                    phase[AbstractSystem::Stats::CounterNames[c]] = stats.phaseCounters[i][c];
+            perf[AbstractSystem::Stats::PhaseNames[i]] = phase;
+        }
+        j["perf"] = perf;
+    }
+    
+    std::ofstream out(opts.statsJson);
+    if (out)
+        out << std::setw(4) << j << std::endl;
+    else
+        cerr << "Failed to open stats file " << opts.statsJson << endl;
+}
+
+static void
+printPerfCounters(const AbstractSystem::Stats& stats, std::ostream& out)
+{
+    using Stats = AbstractSystem::Stats;
+    auto has = [&](int c) { return (stats.counterMask & (1u << c)) != 0; };
+    auto ratio = [](char* buf, std::size_t size, bool valid, double num, double den) {
+        if (valid && den > 0.0)
+            std::snprintf(buf, size, "%10.2f", num / den);
+        else
+            std::snprintf(buf, size, "%10s", "-");
+    };
+    
+    char buf[256];
+    std::snprintf(buf, sizeof(buf), "%-12s %10s %12s %10s %10s %10s\n", "phase", "seconds",
+                  "Mcycles", "IPC", "LLC/kinst", "br/kinst");
+    out << buf;
+    for (int i = 0; i < Stats::NumberOfPhases; ++i) {
+        const auto& c = stats.phaseCounters[i];
+        if (c[Stats::Cycles] <= 0.0 && stats.phaseTime[i] <= 0.0)
+            continue;
+        char ipc[32], llc[32], br[32];
+        double kinst = c[Stats::Instructions] / 1000.0;
+        ratio(ipc, sizeof(ipc), has(Stats::Instructions),
+              c[Stats::Instructions], c[Stats::Cycles]);
+        ratio(llc, sizeof(llc), has(Stats::Instructions) && has(Stats::CacheMisses),
+              c[Stats::CacheMisses], kinst);
+        ratio(br, sizeof(br), has(Stats::Instructions) && has(Stats::BranchMisses),
+              c[Stats::BranchMisses], kinst);
+        std::snprintf(buf, sizeof(buf), "%-12s %10.3f %12.1f %s %s %s\n", Stats::PhaseNames[i],
+                      stats.phaseTime[i], c[Stats::Cycles] / 1e6, ipc, llc, br);
+        out << buf;
+    }
+}
+
+static void
+printEstimate(const Renderer::Estimate& e, const std::string& code, std::ostream& out)
+{
+    char buf[256];
+    std::snprintf(buf, sizeof(buf), "Estimate for variation %s: sampled %s expansions in %.3f s",
+                  code.c_str(), prettyInt(static_cast<unsigned long>(e.sampleExpansions)).c_str(),
+                  e.sampleSeconds);
+    out << buf;
+    if (e.complete) {
+        out << ", which finished the design\n";
+    } else {
+        std::snprintf(buf, sizeof(buf), ",\ndown to shapes of %.3g pixels of the %.3g pixel "
+                      "minimum size\n", e.sizeReached, e.minimumSize);
+        out << buf;
+    }
+    
+    std::snprintf(buf, sizeof(buf), "%-16s %14s %14s %14s\n", "", "estimate", "low", "high");
+    out << buf;
+    auto count = [&](const char* name, const Renderer::Estimate::Range& r) {
+        std::snprintf(buf, sizeof(buf), "%-16s %14.0f %14.0f %14.0f\n", name,
+                      r.value, r.low, r.high);
+        out << buf;
+    };
+    auto scaled = [&](const char* name, const Renderer::Estimate::Range& r, double unit) {
+        std::snprintf(buf, sizeof(buf), "%-16s %14.2f %14.2f %14.2f\n", name,
+                      r.value / unit, r.low / unit, r.high / unit);
+        out << buf;
+    };
+    count("shapes", e.shapes);
+    count("expansions", e.expansions);
+    count("peak pending", e.frontier);
+    scaled("peak memory MB", e.memoryBytes, 1024.0 * 1024.0);
+    scaled("temp files MB", e.spillBytes, 1024.0 * 1024.0);
+    scaled("time s", e.seconds, 1.0);
+}
+
 namespace {
     struct OstreamCloser
     {
@@ -441,6 +615,8 @@ int main (int argc, char* argv[]) {
     clock_t startTime = clock();
     clock_t fromTime = startTime;
     clock_t clocksPerMsec = CLOCKS_PER_SEC / 1000;
+    auto wallStart = std::chrono::steady_clock::now();
+    double parseTime = 0.0;
     
     if (opts.variation < 0) opts.variation = var;
     std::string code = Variation::toString(opts.variation, false);
@@ -473,8 +649,11 @@ int main (int argc, char* argv[]) {
     }
     
     AST::ASTfunction::RandStaticIsConst = opts.format != options::JSONfile;
+    Renderer::ParamStats = !opts.statsJson.empty() || opts.memReport ||
+                           opts.profileRules || opts.estimate;
     cfdg_ptr myDesign = CFDG::ParseFile(opts.input.c_str(), &system,
                                         opts.variation, opts.definitions);
+    parseTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
     if (!myDesign) return 3;
     if (opts.check) return 0;
     if (opts.format == options::JSONfile) {
@@ -532,6 +711,32 @@ int main (int argc, char* argv[]) {
     
     if (opts.maxShapes > 0)
         TheRenderer->setMaxShapes(opts.maxShapes);
+    if (opts.frontierTolerance > 0.0)
+        TheRenderer->setFrontierTolerance(opts.frontierTolerance);
+    if (opts.statsDetailed)
+        TheRenderer->setDetailedStats(true);
+    if (!opts.traceFile.empty() && !TheRenderer->startTrace(opts.traceFile))
+        cerr << "Failed to open trace file " << opts.traceFile << endl;
+    if (opts.profileRules)
+        TheRenderer->profileRules(true);
+    if (opts.memReport)
+        TheRenderer->sampleMemory(true);
+    if (opts.perfCounters) {
+        std::string why;
+        if (!TheRenderer->startPerfCounters(why)) {
+            cerr << "Hardware performance counters are unavailable: " << why << endl;
+            opts.perfCounters = false;
+        }
+    }
+    
+    if (opts.estimate) {
+        Renderer::Estimate estimate = TheRenderer->estimate(EstimateSeconds);
+        if (!opts.quiet) cleanupTimer();
+        if (system.error(false) || TheRenderer->requestStop)
+            return 5;
+        printEstimate(estimate, code, std::cout);
+        return 0;
+    }
         
     if (opts.animationFrames == 0)
         TheRenderer->run(nullptr, false);
@@ -615,6 +820,32 @@ int main (int argc, char* argv[]) {
         *myCout << "The cfdg file took a total of " << prettyInt(runTime) << " msec to process." << endl;
     }
 
+    if (!opts.statsJson.empty()) {
+        double totalTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+        writeStatsJson(opts, code, system.lastStats(), parseTime, totalTime);
+    }
+    
+    if (opts.profileRules) {
+        std::ofstream folded;
+        if (!opts.profileFolded.empty()) {
+            folded.open(opts.profileFolded);
+            if (!folded)
+                cerr << "Failed to open rule profile file " << opts.profileFolded << endl;
+        }
+        cerr << endl;
+        TheRenderer->ruleProfile(cerr, folded.is_open() ? &folded : nullptr);
+    }
+    
+    if (opts.memReport) {
+        cerr << endl;
+        TheRenderer->memoryReport(cerr);
+    }
+    
+    if (opts.perfCounters) {
+        cerr << endl;
+        printPerfCounters(system.lastStats(), cerr);
+    }
+
         Renderer::AbortEverything = !(opts.paramTest);
         actualFileName = myCanvas->mFileName;
     }   // delete canvas & renderer
@@ -254,12 +254,12 @@ PosixSystem::normalize(const std::string& u8name)
     }
     
     // NFKC normalize utf-16 text 
-    std::wstring ret(u16name.length(), L' ');
+    std::u16string ret(u16name.length(), u' ');
     for (;;) {
-        UChar* dest = reinterpret_cast<UChar*>(&ret[0]);
+        status = U_ZERO_ERROR;
         auto sz = unorm2_normalize(mNormalizer,
                                    u16name.data(), static_cast<int32_t>(u16name.length()),
-                                   dest, static_cast<int32_t>(ret.length()+1),
+                                   &ret[0], static_cast<int32_t>(ret.length()+1),
                                    &status);
         if (U_FAILURE(status) && status != U_BUFFER_OVERFLOW_ERROR) {
             CfdgError::Error(CfdgError::Default, "String conversion error");
@@ -268,9 +268,11 @@ PosixSystem::normalize(const std::string& u8name)
             ret.resize(sz);
             break;
         } else {
-            ret.resize(sz + 1, L' ');
+            ret.resize(sz + 1, u' ');
         }
     }
-    return ret;
+    // One utf-16 code unit per wchar_t, as on Windows, so that ASCII names
+    // come out unchanged
+    return std::wstring(ret.begin(), ret.end());
 }
 